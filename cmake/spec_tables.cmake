@@ -0,0 +1,83 @@
+# Extracts the named constants and the type property table from the
+# specification, so that the headers can be checked against the text they
+# are written from.
+#
+#   cmake -DSPEC=v1 -DOUT=spec.inc -P cmake/spec_tables.cmake
+#
+# Writes one COIL_CONST(name, value) per constant defined at the start of a
+# line in any file of the specification, and one
+# COIL_ROW(main, category, size, align, reg_class) per row of the property
+# table of type.md, with the size markers P, D, R, T and - as their SIZE_*
+# names.
+
+file(GLOB spec_files "${SPEC}/*.md" "${SPEC}/isa/*.md")
+list(SORT spec_files)
+
+set(markers_P SIZE_PLATFORM)
+set(markers_D SIZE_DEFINITION)
+set(markers_R SIZE_RUNTIME)
+set(markers_T SIZE_TSHAPE)
+set(markers_- SIZE_NONE)
+
+function(size_of field out)
+  if(field MATCHES "^[0-9]+$")
+    set(${out} "${field}" PARENT_SCOPE)
+  elseif(DEFINED markers_${field})
+    set(${out} "${markers_${field}}" PARENT_SCOPE)
+  else()
+    message(FATAL_ERROR "type.md: unknown size or alignment `${field}`")
+  endif()
+endfunction()
+
+set(constant "([A-Z][A-Za-z0-9_]*) *= *(0x[0-9A-Fa-f]+|\\(1 << [0-7]\\))")
+
+set(consts "")
+set(rows "")
+foreach(path IN LISTS spec_files)
+  file(RELATIVE_PATH name "${SPEC}" "${path}")
+  file(STRINGS "${path}" lines)
+  string(APPEND consts "// ${name}\n")
+  foreach(line IN LISTS lines)
+    # A line can define more than one constant, as the feature IDs of isa/spec.md do
+    if(line MATCHES "^${constant}")
+      string(REGEX MATCHALL "${constant}" defs "${line}")
+      foreach(def IN LISTS defs)
+        string(REGEX MATCH "^${constant}$" _ "${def}")
+        string(APPEND consts "COIL_CONST(${CMAKE_MATCH_1}, ${CMAKE_MATCH_2})\n")
+      endforeach()
+    elseif(name STREQUAL "type.md" AND line MATCHES "^\\| *(TYPE_[A-Za-z0-9_]+)( - (TYPE_[A-Za-z0-9_]+))? *\\| *([A-Z]+) *\\| *([^ |]+) *\\| *([^ |]+) *\\| *([A-Z]+) *\\|$")
+      set(first "${CMAKE_MATCH_1}")
+      set(last "${CMAKE_MATCH_3}")
+      set(cat "${CMAKE_MATCH_4}")
+      set(cls "${CMAKE_MATCH_7}")
+      size_of("${CMAKE_MATCH_5}" size)
+      size_of("${CMAKE_MATCH_6}" align)
+      # A range row names the lowest and highest numbered type of a family
+      if(last)
+        string(REGEX MATCH "^(.*[^0-9])([0-9]+)$" _ "${first}")
+        set(stem "${CMAKE_MATCH_1}")
+        set(from "${CMAKE_MATCH_2}")
+        string(REGEX MATCH "([0-9]+)$" _ "${last}")
+        set(names "")
+        foreach(n RANGE ${from} ${CMAKE_MATCH_1})
+          list(APPEND names "${stem}${n}")
+        endforeach()
+      else()
+        set(names "${first}")
+      endif()
+      foreach(type IN LISTS names)
+        string(APPEND rows "COIL_ROW(${type}, TYPE_CAT_${cat}, ${size}, ${align}, REG_CLASS_${cls})\n")
+      endforeach()
+    endif()
+  endforeach()
+endforeach()
+
+if(rows STREQUAL "")
+  message(FATAL_ERROR "no property table found in ${SPEC}/type.md")
+endif()
+
+set(text "// Generated from the specification by cmake/spec_tables.cmake, do not edit\n\n")
+string(APPEND text "#ifdef COIL_CONST\n${consts}#endif\n\n#ifdef COIL_ROW\n${rows}#endif\n")
+file(WRITE "${OUT}.tmp" "${text}")
+file(COPY_FILE "${OUT}.tmp" "${OUT}" ONLY_IF_DIFFERENT)
+file(REMOVE "${OUT}.tmp")
@@ -0,0 +1,18 @@
+/* Reference for atomic_counter.cas */
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+void ref_atomic_counter(const void *in, void *out) {
+  const uint64_t *x = in;
+  uint64_t *y = out;
+  _Atomic uint64_t counter = x[0];
+  uint64_t mix = 0;
+  for (int i = 0; i < 1024; i++) mix ^= atomic_fetch_add(&counter, x[1 + i] & 0xFFFF);
+  uint64_t final = atomic_load_explicit(&counter, memory_order_acquire);
+  uint64_t expected = final;
+  atomic_compare_exchange_strong_explicit(&counter, &expected, 0, memory_order_acq_rel, memory_order_acquire);
+  y[0] = final;
+  y[1] = mix;
+  y[2] = expected;
+}
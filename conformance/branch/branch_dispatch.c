@@ -0,0 +1,17 @@
+/* Reference for branch_dispatch.cas */
+
+#include <stdint.h>
+
+void ref_branch_dispatch(const void *in, void *out) {
+  const uint8_t *code = in;
+  uint64_t acc = 1;
+  for (int i = 0; i < 4096; i++) {
+    switch (code[i] & 3) {
+      case 0: acc += 1; break;
+      case 1: acc *= 3; break;
+      case 2: acc ^= 0x55; break;
+      case 3: acc >>= 1; break;
+    }
+  }
+  *(uint64_t *)out = acc;
+}
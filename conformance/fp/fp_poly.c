@@ -0,0 +1,16 @@
+/* Reference for fp_poly.cas */
+
+#include <math.h>
+#include <stdint.h>
+
+void ref_fp_poly(const void *in, void *out) {
+  const double *x = in;
+  double *y = out;
+  int32_t *z = (int32_t *)(y + 1024);
+  for (int i = 0; i < 1024; i++) {
+    double p = fma(fma(x[i], 0.5, 1.25), x[i], -3.0);
+    p += sqrt(fabs(p));
+    y[i] = p;
+    z[i] = (int32_t)(p * 100.0);
+  }
+}
@@ -0,0 +1,15 @@
+/* Reference for int_hash.cas */
+
+#include <stdint.h>
+
+void ref_int_hash(const void *in, void *out) {
+  const uint64_t *x = in;
+  uint64_t *y = out;
+  for (int i = 0; i < 1024; i++) {
+    uint64_t v = x[i];
+    uint64_t h = (v * 0x9E3779B97F4A7C15u) ^ (v >> 29);
+    h += (uint64_t)__builtin_popcountll(v);
+    __extension__ unsigned __int128 p = (unsigned __int128)v * h;
+    y[i] = (uint64_t)(p >> 64) ^ (uint64_t)p;
+  }
+}
@@ -0,0 +1,12 @@
+/* Reference for gemm_f32_16.cas, each element summed in order of k */
+
+void ref_gemm_f32_16(const void *in, void *out) {
+  const float *a = in, *b = a + 256;
+  float *c = out;
+  for (int i = 0; i < 16; i++)
+    for (int j = 0; j < 16; j++) {
+      float acc = 0;
+      for (int k = 0; k < 16; k++) acc += a[16 * i + k] * b[16 * k + j];
+      c[16 * i + j] = acc;
+    }
+}
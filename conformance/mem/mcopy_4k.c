@@ -0,0 +1,8 @@
+/* Reference for mcopy_4k.cas */
+
+#include <string.h>
+
+void ref_mcopy_4k(const void *in, void *out) {
+  memcpy(out, in, 4096);
+  memset((char *)out + 4096, 0xAB, 256);
+}
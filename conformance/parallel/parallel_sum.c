@@ -0,0 +1,10 @@
+/* Reference for parallel_sum.cas */
+
+#include <stdint.h>
+
+void ref_parallel_sum(const void *in, void *out) {
+  const uint32_t *x = in;
+  uint64_t sum = 0;
+  for (int i = 0; i < 1024; i++) sum += (uint64_t)x[i] * x[i];
+  *(uint64_t *)out = sum;
+}
@@ -0,0 +1,9 @@
+/* Reference for vec_saxpy.cas */
+
+#include <math.h>
+
+void ref_vec_saxpy(const void *in, void *out) {
+  const float *x = in, *y = x + 1024;
+  float *r = out;
+  for (int i = 0; i < 1024; i++) r[i] = fmaf(1.5f, x[i], y[i]);
+}
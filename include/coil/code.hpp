@@ -0,0 +1,96 @@
+// Encoding COIL instructions (v1/overview.md), for assemblers and tests
+
+#ifndef COIL_CODE_HPP
+#define COIL_CODE_HPP
+
+#include <coil/object.hpp>
+#include <coil/type.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+namespace coil {
+
+// An operand in the normal encoding, a type word and the bytes of its value
+struct operand {
+  uint16_t word = 0;
+  std::vector<uint8_t> value;
+};
+
+inline operand var(uint32_t id, uint8_t main) {
+  operand o{type_word(main, TYPEEXT_VAR), std::vector<uint8_t>(4)};
+  std::memcpy(o.value.data(), &id, 4);
+  return o;
+}
+
+inline operand sym(uint32_t index, uint8_t main = TYPE_SYM, uint8_t ext = 0) {
+  operand o{type_word(main, main == TYPE_SYM ? ext : ext | TYPEEXT_SYM), std::vector<uint8_t>(4)};
+  std::memcpy(o.value.data(), &index, 4);
+  return o;
+}
+
+inline operand param(uint8_t value) { return {type_word(TYPE_PARAM0), {value}}; }
+
+inline operand type_operand(uint8_t main) { return {type_word(main), {}}; }
+
+// An immediate from the bytes of its value, size given by immediate_size()
+inline operand imm_bytes(uint8_t main, const void *bytes, size_t size) {
+  operand o{type_word(main, TYPEEXT_IMM), std::vector<uint8_t>(immediate_size(main))};
+  if (o.value.empty()) throw error("code: main type " + std::to_string(main) + " can not be an immediate");
+  std::memcpy(o.value.data(), bytes, size < o.value.size() ? size : o.value.size());
+  return o;
+}
+
+// An integer immediate, sign extended to the size of main
+inline operand imm(uint8_t main, int64_t value) {
+  uint8_t bytes[16];
+  std::memset(bytes, value < 0 ? 0xFF : 0, sizeof bytes);
+  std::memcpy(bytes, &value, 8);
+  return imm_bytes(main, bytes, sizeof bytes);
+}
+
+inline operand imm_fp(uint8_t main, double value) {
+  if (main == TYPE_FP32) {
+    float f = static_cast<float>(value);
+    return imm_bytes(main, &f, 4);
+  }
+  return imm_bytes(main, &value, 8);
+}
+
+// Appends instructions to a code section
+class code_writer {
+ public:
+  explicit code_writer(std::vector<uint8_t> &code) : code_(code) {}
+
+  uint64_t offset() const { return code_.size(); }
+
+  void insn(uint8_t opcode, std::initializer_list<operand> operands) { insn(opcode, std::vector<operand>(operands)); }
+
+  void insn(uint8_t opcode, const std::vector<operand> &operands) {
+    size_t start = code_.size();
+    if (operands.size() > 255) throw error("code: more than 255 operands");
+    code_.push_back(opcode);
+    code_.push_back(static_cast<uint8_t>(operands.size()));
+    code_.push_back(0);
+    code_.push_back(0);
+    for (const operand &o : operands) {
+      code_.push_back(static_cast<uint8_t>(o.word));
+      code_.push_back(static_cast<uint8_t>(o.word >> 8));
+      code_.insert(code_.end(), o.value.begin(), o.value.end());
+    }
+    while ((code_.size() - start) % 4 != 0) code_.push_back(0);
+    size_t length = code_.size() - start;
+    if (length > 65532) throw error("code: instruction longer than 65532 bytes");
+    code_[start + 2] = static_cast<uint8_t>(length);
+    code_[start + 3] = static_cast<uint8_t>(length >> 8);
+  }
+
+ private:
+  std::vector<uint8_t> &code_;
+};
+
+}  // namespace coil
+
+#endif
@@ -0,0 +1,72 @@
+// Reference COIL execution engine (v1/impl.md)
+//
+// The engine runs COIL code on the host without translating it to native
+// code. Each function is decoded once, on its first call, into an array of
+// fixed size records with operand types resolved to specialized handlers,
+// variables resolved to frame slots and branch targets resolved to record
+// indices, and run by a threaded dispatch loop. Directives are applied by
+// the decoder and never reach the dispatch loop.
+//
+// The engine is the target of the code it runs, a 64-bit little endian CPU.
+// TYPE_INT, TYPE_LINT, TYPE_UNT, TYPE_LUNT and the pointer types are 64 bits
+// and TYPE_FP is a TYPE_FP64, TYPE_VS is 64 bytes. Everything the engine
+// does not run, such as register operands, composite types or the offload
+// instructions, is rejected with an error when the function is decoded, so a
+// function either runs as specified or not at all.
+//
+// DIR_PARALLEL loops are run serially, which isa/dir.md allows for a COIL
+// processor without a parallel runtime. Functions can be called from any
+// number of threads at once, loading objects can not overlap with calls.
+
+#ifndef COIL_ENGINE_HPP
+#define COIL_ENGINE_HPP
+
+#include <coil/object.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace coil {
+
+class function;
+
+class engine {
+ public:
+  engine();
+  ~engine();
+  engine(const engine &) = delete;
+  engine &operator=(const engine &) = delete;
+
+  // Copies the data sections of the object and applies its relocations.
+  // A relocation against an undefined symbol is resolved from the objects
+  // loaded before it, symbols referenced by code from every loaded object.
+  void load(object obj);
+
+  // The function defined under a global or weak symbol, nullptr when no
+  // loaded object defines one. A global definition takes the place of a weak
+  // one in an object loaded before it.
+  function *find(std::string_view name) const;
+  // Address of the data defined under a global or weak symbol, or nullptr
+  void *data(std::string_view name) const;
+
+  // Decodes the function now instead of on its first call, reporting any
+  // error in it
+  void prepare(function &fn);
+
+  // Calls fn with integer, pointer or floating point arguments, each held in
+  // the low bytes of one 64-bit word, and writes its results the same way.
+  // Results not returned by the function are zero.
+  void call(function &fn, std::span<const uint64_t> args, std::span<uint64_t> results = {});
+
+  struct image;
+
+ private:
+  std::vector<std::unique_ptr<image>> images_;
+};
+
+}  // namespace coil
+
+#endif
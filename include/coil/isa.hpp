@@ -0,0 +1,369 @@
+// COIL opcodes, parameters and IDs (v1/isa, v1/type.md, v1/reg.md, v1/abi.md)
+//
+// Each table is an X macro list of name and value, so that the constants
+// below, name lookups in tools and any other table keyed by them are all
+// expanded from the one list. The lists are checked against the
+// specification by tests/spec_constants.cpp.
+
+#ifndef COIL_ISA_HPP
+#define COIL_ISA_HPP
+
+#include <cstdint>
+
+// Opcodes, one byte
+#define COIL_OPCODES(X) \
+  /* isa/cf.md */ \
+  X(NOP,     0x00)  \
+  X(BR,      0x01)  \
+  X(CALL,    0x02)  \
+  X(RET,     0x03)  \
+  X(ENTER,   0x04)  \
+  X(SWITCH,  0x10)  \
+  X(SWITCHS, 0x11)  \
+  X(BADDR,   0x12)  \
+  X(BRI,     0x13)  \
+  /* isa/memops.md */ \
+  X(MOV,      0x20)  \
+  X(LOAD,     0x21)  \
+  X(STORE,    0x22)  \
+  X(XCHG,     0x28)  \
+  X(CAS,      0x29)  \
+  X(FETCH,    0x2A)  \
+  X(FENCE,    0x2B)  \
+  X(PREFETCH, 0x2C)  \
+  X(CACHE,    0x2D)  \
+  X(MCOPY,    0x30)  \
+  X(MMOVE,    0x31)  \
+  X(MFILL,    0x32)  \
+  X(MCMP,     0x33)  \
+  X(MCOPYA,   0x34)  \
+  X(SALLOC,   0x35)  \
+  /* isa/arith.md */ \
+  X(ADD,    0x40)  \
+  X(SUB,    0x41)  \
+  X(MUL,    0x42)  \
+  X(DIV,    0x43)  \
+  X(REM,    0x44)  \
+  X(NEG,    0x45)  \
+  X(AND,    0x46)  \
+  X(OR,     0x47)  \
+  X(XOR,    0x48)  \
+  X(NOT,    0x49)  \
+  X(SHL,    0x4A)  \
+  X(SHR,    0x4B)  \
+  X(ROL,    0x4C)  \
+  X(ROR,    0x4D)  \
+  X(CMP,    0x4E)  \
+  X(SEL,    0x4F)  \
+  X(MIN,    0x50)  \
+  X(MAX,    0x51)  \
+  X(ABS,    0x52)  \
+  X(FMA,    0x53)  \
+  X(SQRT,   0x54)  \
+  X(POPCNT, 0x60)  \
+  X(CLZ,    0x61)  \
+  X(CTZ,    0x62)  \
+  X(FFS,    0x63)  \
+  X(BPOP,   0x64)  \
+  X(BFIND,  0x65)  \
+  X(BOP,    0x66)  \
+  X(ADDC,   0x68)  \
+  X(SUBB,   0x69)  \
+  X(MULW,   0x6A)  \
+  X(ADDSAT, 0x6B)  \
+  X(SUBSAT, 0x6C)  \
+  X(FMAW,   0x70)  \
+  X(DOT,    0x71)  \
+  /* isa/vec.md */ \
+  X(VLOAD,    0x80)  \
+  X(VSTORE,   0x81)  \
+  X(VLOADM,   0x82)  \
+  X(VSTOREM,  0x83)  \
+  X(VGATHER,  0x84)  \
+  X(VSCATTER, 0x85)  \
+  X(VSPLAT,   0x86)  \
+  X(VEXTRACT, 0x87)  \
+  X(VINSERT,  0x88)  \
+  X(VSHUFFLE, 0x89)  \
+  X(VPERMUTE, 0x8A)  \
+  X(VADD,     0x8B)  \
+  X(VSUB,     0x8C)  \
+  X(VMUL,     0x8D)  \
+  X(VDIV,     0x8E)  \
+  X(VMIN,     0x8F)  \
+  X(VMAX,     0x90)  \
+  X(VAND,     0x91)  \
+  X(VOR,      0x92)  \
+  X(VXOR,     0x93)  \
+  X(VSHL,     0x94)  \
+  X(VSHR,     0x95)  \
+  X(VFMA,     0x96)  \
+  X(VCMP,     0x97)  \
+  X(VSELECT,  0x98)  \
+  X(VREDUCE,  0x99)  \
+  X(VCVT,     0x9A)  \
+  X(VSETVL,   0x9B)  \
+  X(VLANES,   0x9C)  \
+  /* isa/type.md */ \
+  X(CVT,     0xA0)  \
+  X(TYPEDEF, 0xA1)  \
+  /* isa/dir.md */ \
+  X(DIR_HINT,     0xB0)  \
+  X(DIR_PROFILE,  0xB1)  \
+  X(DIR_ABI,      0xB2)  \
+  X(DIR_PU,       0xB3)  \
+  X(DIR_ARCH,     0xB4)  \
+  X(DIR_ASSUME,   0xB5)  \
+  X(DIR_VERSION,  0xB6)  \
+  X(DIR_KERNEL,   0xB7)  \
+  X(DIR_SPACE,    0xB8)  \
+  X(DIR_PARALLEL, 0xB9)  \
+  X(DIR_LIFE,     0xBA)  \
+  X(DIR_REGION,   0xBB)  \
+  /* isa/spec.md */ \
+  X(TSHAPE,  0xC0)  \
+  X(TLOAD,   0xC1)  \
+  X(TSTORE,  0xC2)  \
+  X(TZERO,   0xC3)  \
+  X(TMMA,    0xC4)  \
+  X(LAUNCH,  0xC5)  \
+  X(WAIT,    0xC6)  \
+  X(KID,     0xC7)  \
+  X(BARRIER, 0xC8)  \
+  X(HASFEAT, 0xD0)
+
+// Parameter values, the one byte value of a TYPE_PARAMn operand
+#define COIL_PARAMS(X) \
+  /* Branch Conditions */ \
+  X(BRANCH_COND_EQ, 0x00)  \
+  X(BRANCH_COND_NE, 0x01)  \
+  X(BRANCH_COND_GE, 0x02)  \
+  X(BRANCH_COND_LT, 0x03)  \
+  X(BRANCH_COND_GT, 0x04)  \
+  X(BRANCH_COND_LE, 0x05)  \
+  X(BRANCH_COND_Z,  0x06)  \
+  X(BRANCH_COND_NZ, 0x07)  \
+  X(BRANCH_COND_C,  0x08)  \
+  X(BRANCH_COND_NC, 0x09)  \
+  X(BRANCH_COND_O,  0x0A)  \
+  X(BRANCH_COND_NO, 0x0B)  \
+  X(BRANCH_COND_S,  0x0C)  \
+  X(BRANCH_COND_NS, 0x0D)  \
+  /* Branch Control */ \
+  X(BRANCH_CTRL_FAR,       0x00)  \
+  X(BRANCH_CTRL_INL,       0x01)  \
+  X(BRANCH_CTRL_ABI,       0x02)  \
+  X(BRANCH_CTRL_ABI_PARAM, 0x03)  \
+  X(BRANCH_CTRL_ABI_RET,   0x04)  \
+  X(BRANCH_CTRL_TAIL,      0x05)  \
+  /* Memory Control */ \
+  X(MEMORY_CTRL_ATOMIC,      0x01)  \
+  X(MEMORY_CTRL_VOLATILE,    0x02)  \
+  X(MEMORY_CTRL_ALIGNED,     0x03)  \
+  X(MEMORY_CTRL_UNALIGNED,   0x04)  \
+  X(MEMORY_CTRL_NONTEMPORAL, 0x05)  \
+  /* Reductions */ \
+  X(REDUCE_ADD,     0x00)  \
+  X(REDUCE_MIN,     0x01)  \
+  X(REDUCE_MAX,     0x02)  \
+  X(REDUCE_AND,     0x03)  \
+  X(REDUCE_OR,      0x04)  \
+  X(REDUCE_XOR,     0x05)  \
+  X(REDUCE_ADD_ORD, 0x06)  \
+  /* Memory Order */ \
+  X(MEMORY_ORDER_RELAXED, 0x00)  \
+  X(MEMORY_ORDER_ACQUIRE, 0x01)  \
+  X(MEMORY_ORDER_RELEASE, 0x02)  \
+  X(MEMORY_ORDER_ACQ_REL, 0x03)  \
+  X(MEMORY_ORDER_SEQ_CST, 0x04)  \
+  /* Atomic Operations */ \
+  X(FETCH_OP_ADD,       0x00)  \
+  X(FETCH_OP_SUB,       0x01)  \
+  X(FETCH_OP_AND,       0x02)  \
+  X(FETCH_OP_OR,        0x03)  \
+  X(FETCH_OP_XOR,       0x04)  \
+  X(FETCH_OP_MIN,       0x05)  \
+  X(FETCH_OP_MAX,       0x06)  \
+  X(CAS_STRONG,         0x00)  \
+  X(CAS_WEAK,           0x01)  \
+  X(FENCE_SCOPE_THREAD, 0x00)  \
+  X(FENCE_SCOPE_SIGNAL, 0x01)  \
+  /* Cache Control */ \
+  X(PREFETCH_READ,          0x00)  \
+  X(PREFETCH_WRITE,         0x01)  \
+  X(PREFETCH_LOCALITY_NONE, 0x00)  \
+  X(PREFETCH_LOCALITY_L3,   0x01)  \
+  X(PREFETCH_LOCALITY_L2,   0x02)  \
+  X(PREFETCH_LOCALITY_L1,   0x03)  \
+  X(CACHE_OP_FLUSH,         0x00)  \
+  X(CACHE_OP_CLEAN,         0x01)  \
+  X(CACHE_OP_ZERO,          0x02)  \
+  /* Bit Operations */ \
+  X(BITOP_AND,   0x00)  \
+  X(BITOP_OR,    0x01)  \
+  X(BITOP_XOR,   0x02)  \
+  X(BITOP_ANDN,  0x03)  \
+  X(BFIND_SET,   0x00)  \
+  X(BFIND_CLEAR, 0x01)  \
+  /* Rounding and Saturation */ \
+  X(ROUND_NEAREST, 0x00)  \
+  X(ROUND_ZERO,    0x01)  \
+  X(ROUND_UP,      0x02)  \
+  X(ROUND_DOWN,    0x03)  \
+  X(SAT_NONE,      0x00)  \
+  X(SAT,           0x01)  \
+  /* Branch Hints */ \
+  X(BRANCH_HINT_NONE,     0x00)  \
+  X(BRANCH_HINT_LIKELY,   0x01)  \
+  X(BRANCH_HINT_UNLIKELY, 0x02)  \
+  X(BRANCH_HINT_PROB,     0x03)  \
+  /* Code Hints */ \
+  X(HINT_HOT,         0x00)  \
+  X(HINT_COLD,        0x01)  \
+  X(HINT_SCOPE_FUNC,  0x00)  \
+  X(HINT_SCOPE_BLOCK, 0x01)  \
+  /* Profiling */ \
+  X(PROFILE_BLOCK, 0x00)  \
+  X(PROFILE_EDGE,  0x01)  \
+  /* ABI Lists */ \
+  X(ABI_LIST_PARAM,  0x00)  \
+  X(ABI_LIST_RESULT, 0x01)  \
+  X(ABI_LIST_CALLEE, 0x02)  \
+  /* Assumptions */ \
+  X(ASSUME_ALIGNED, 0x00)  \
+  X(ASSUME_NOALIAS, 0x01)  \
+  /* Layout */ \
+  X(LAYOUT_ALIGN,      0x00)  \
+  X(LAYOUT_ALIGN_LINE, 0x01)  \
+  X(LAYOUT_OFFSET,     0x02)  \
+  X(LAYOUT_SIZE,       0x03)  \
+  /* Offload */ \
+  X(KID_THREAD_X,   0x00)  \
+  X(KID_THREAD_Y,   0x01)  \
+  X(KID_THREAD_Z,   0x02)  \
+  X(KID_GROUP_X,    0x03)  \
+  X(KID_GROUP_Y,    0x04)  \
+  X(KID_GROUP_Z,    0x05)  \
+  X(KID_SIZE_X,     0x06)  \
+  X(KID_SIZE_Y,     0x07)  \
+  X(KID_SIZE_Z,     0x08)  \
+  X(KID_GRID_X,     0x09)  \
+  X(KID_GRID_Y,     0x0A)  \
+  X(KID_GRID_Z,     0x0B)  \
+  X(SPACE_HOST,     0x00)  \
+  X(SPACE_DEVICE,   0x01)  \
+  X(SPACE_SHARED,   0x02)  \
+  X(SPACE_CONSTANT, 0x03)  \
+  X(SPACE_UNIFIED,  0x04)  \
+  /* Parallel Schedule */ \
+  X(SCHED_AUTO,    0x00)  \
+  X(SCHED_STATIC,  0x01)  \
+  X(SCHED_DYNAMIC, 0x02)  \
+  X(SCHED_STEAL,   0x03)  \
+  /* Lifetimes */ \
+  X(LIFE_BEGIN,   0x00)  \
+  X(LIFE_END,     0x01)  \
+  X(REGION_BEGIN, 0x00)  \
+  X(REGION_END,   0x01)
+
+// Target context, ABI and feature IDs, TYPE_UNT16 immediates
+#define COIL_IDS(X) \
+  /* reg.md */ \
+  X(PU_CPU,        0x0001)  \
+  X(PU_GPU,        0x0002)  \
+  X(ARCH_X86_16,   0x0001)  \
+  X(ARCH_X86_32,   0x0002)  \
+  X(ARCH_X86_64,   0x0003)  \
+  X(ARCH_ARM_32,   0x0004)  \
+  X(ARCH_ARM_64,   0x0005)  \
+  X(ARCH_RISCV_32, 0x0006)  \
+  X(ARCH_RISCV_64, 0x0007)  \
+  X(ARCH_PTX,      0x0100)  \
+  X(ARCH_AMDGCN,   0x0101)  \
+  X(ARCH_SPIRV,    0x0102)  \
+  /* abi.md */ \
+  X(ABI_DEFAULT,     0x0000)  \
+  X(ABI_COIL,        0x0001)  \
+  X(ABI_SYSV_X64,    0x0010)  \
+  X(ABI_WIN_X64,     0x0011)  \
+  X(ABI_VECTORCALL,  0x0012)  \
+  X(ABI_AAPCS64,     0x0020)  \
+  X(ABI_RISCV_LP64D, 0x0030)  \
+  /* isa/spec.md, x86-32 and x86-64 */ \
+  X(FEAT_X86_SSE3,        0x0001)  \
+  X(FEAT_X86_SSSE3,       0x0002)  \
+  X(FEAT_X86_SSE4_1,      0x0003)  \
+  X(FEAT_X86_SSE4_2,      0x0004)  \
+  X(FEAT_X86_POPCNT,      0x0005)  \
+  X(FEAT_X86_AVX,         0x0006)  \
+  X(FEAT_X86_AVX2,        0x0007)  \
+  X(FEAT_X86_FMA,         0x0008)  \
+  X(FEAT_X86_BMI1,        0x0009)  \
+  X(FEAT_X86_BMI2,        0x000A)  \
+  X(FEAT_X86_LZCNT,       0x000B)  \
+  X(FEAT_X86_ADX,         0x000C)  \
+  X(FEAT_X86_F16C,        0x000D)  \
+  X(FEAT_X86_PREFETCHW,   0x000E)  \
+  X(FEAT_X86_CMOV,        0x000F)  \
+  X(FEAT_X86_AVX512F,     0x0010)  \
+  X(FEAT_X86_AVX512BW,    0x0011)  \
+  X(FEAT_X86_AVX512DQ,    0x0012)  \
+  X(FEAT_X86_AVX512VL,    0x0013)  \
+  X(FEAT_X86_AVX512VNNI,  0x0014)  \
+  X(FEAT_X86_AVX512BF16,  0x0015)  \
+  X(FEAT_X86_AVXVNNI,     0x0016)  \
+  X(FEAT_X86_AMX_TILE,    0x0017)  \
+  X(FEAT_X86_AMX_BF16,    0x0018)  \
+  X(FEAT_X86_AMX_INT8,    0x0019)  \
+  X(FEAT_X86_AVX10_2,     0x001A)  \
+  X(FEAT_X86_ERMS,        0x0020)  \
+  X(FEAT_X86_FSRM,        0x0021)  \
+  X(FEAT_X86_CLWB,        0x0022)  \
+  X(FEAT_X86_CLFLUSHOPT,  0x0023)  \
+  X(FEAT_X86_SSE,         0x0030)  \
+  X(FEAT_X86_SSE2,        0x0031)  \
+  /* isa/spec.md, ARM-64 */ \
+  X(FEAT_ARM_CRC32,       0x0001)  \
+  X(FEAT_ARM_LSE,         0x0002)  \
+  X(FEAT_ARM_DOTPROD,     0x0003)  \
+  X(FEAT_ARM_FP16,        0x0004)  \
+  X(FEAT_ARM_BF16,        0x0005)  \
+  X(FEAT_ARM_I8MM,        0x0006)  \
+  X(FEAT_ARM_SVE,         0x0010)  \
+  X(FEAT_ARM_SVE2,        0x0011)  \
+  X(FEAT_ARM_SME,         0x0012)  \
+  X(FEAT_ARM_FP8DOT4,     0x0013)  \
+  X(FEAT_ARM_MOPS,        0x0020)  \
+  /* isa/spec.md, RISCV-32 and RISCV-64 */ \
+  X(FEAT_RISCV_M,         0x0001)  \
+  X(FEAT_RISCV_A,         0x0002)  \
+  X(FEAT_RISCV_F,         0x0003)  \
+  X(FEAT_RISCV_D,         0x0004)  \
+  X(FEAT_RISCV_C,         0x0005)  \
+  X(FEAT_RISCV_ZBA,       0x0006)  \
+  X(FEAT_RISCV_ZBB,       0x0007)  \
+  X(FEAT_RISCV_ZBS,       0x0008)  \
+  X(FEAT_RISCV_ZABHA,     0x0009)  \
+  X(FEAT_RISCV_V,         0x0010)  \
+  X(FEAT_RISCV_ZVFH,      0x0011)  \
+  X(FEAT_RISCV_ZVFBFWMA,  0x0012)  \
+  X(FEAT_RISCV_ZICBOM,    0x0020)  \
+  X(FEAT_RISCV_ZICBOZ,    0x0021)  \
+  X(FEAT_RISCV_ZICBOP,    0x0022)  \
+  X(FEAT_RISCV_ZIHINTNTL, 0x0023)  \
+  X(FEAT_RISCV_ZFH,       0x0024)
+
+namespace coil {
+
+#define COIL_CONSTANT(name, value) inline constexpr uint8_t name = value;
+COIL_OPCODES(COIL_CONSTANT)
+COIL_PARAMS(COIL_CONSTANT)
+#undef COIL_CONSTANT
+
+#define COIL_CONSTANT(name, value) inline constexpr uint16_t name = value;
+COIL_IDS(COIL_CONSTANT)
+#undef COIL_CONSTANT
+
+}  // namespace coil
+
+#endif
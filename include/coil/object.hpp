@@ -0,0 +1,194 @@
+// COIL objects (v1/obj.md)
+//
+// An object is read in place from one buffer. Opening it validates the
+// header and the section directory and nothing else, sections and symbols
+// are only looked at when something asks for them.
+
+#ifndef COIL_OBJECT_HPP
+#define COIL_OBJECT_HPP
+
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace coil {
+
+static_assert(std::endian::native == std::endian::little, "objects are read in place, which needs a little endian host");
+
+// Section types
+inline constexpr uint16_t SECT_NULL    = 0x00;
+inline constexpr uint16_t SECT_CODE    = 0x01;
+inline constexpr uint16_t SECT_DATA    = 0x02;
+inline constexpr uint16_t SECT_RODATA  = 0x03;
+inline constexpr uint16_t SECT_BSS     = 0x04;
+inline constexpr uint16_t SECT_STRTAB  = 0x05;
+inline constexpr uint16_t SECT_SYMTAB  = 0x06;
+inline constexpr uint16_t SECT_SYMHASH = 0x07;
+inline constexpr uint16_t SECT_RELOC   = 0x08;
+inline constexpr uint16_t SECT_FUNC    = 0x09;
+
+// Section flags
+inline constexpr uint32_t SECT_FLAG_WRITE   = 1 << 0;
+inline constexpr uint32_t SECT_FLAG_TLS     = 1 << 1;
+inline constexpr uint32_t SECT_FLAG_COMPACT = 1 << 2;
+
+// Symbol kinds and bindings
+inline constexpr uint8_t SYM_KIND_NONE = 0x00;
+inline constexpr uint8_t SYM_KIND_FUNC = 0x01;
+inline constexpr uint8_t SYM_KIND_DATA = 0x02;
+inline constexpr uint8_t SYM_KIND_SECT = 0x03;
+
+inline constexpr uint8_t SYM_BIND_LOCAL  = 0x00;
+inline constexpr uint8_t SYM_BIND_GLOBAL = 0x01;
+inline constexpr uint8_t SYM_BIND_WEAK   = 0x02;
+
+// Relocation types
+inline constexpr uint16_t RELOC_ADDR   = 0x01;
+inline constexpr uint16_t RELOC_ADDR32 = 0x02;
+inline constexpr uint16_t RELOC_ADDR64 = 0x03;
+inline constexpr uint16_t RELOC_REL32  = 0x04;
+
+// Raised for input that does not follow the specification and for anything
+// valid that a tool does not support, the message says which
+class error : public std::runtime_error {
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+struct object_header {
+  uint8_t magic[4];
+  uint16_t major;
+  uint16_t minor;
+  uint32_t flags;
+  uint32_t section_count;
+  uint64_t directory;
+  uint64_t file_size;
+  uint32_t strtab;
+  uint32_t symtab;
+  uint8_t reserved[24];
+};
+
+struct section_header {
+  uint32_t name;
+  uint16_t type;
+  uint8_t align;  // power of two
+  uint8_t reserved;
+  uint32_t flags;
+  uint32_t link;
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct symbol_entry {
+  uint32_t name;
+  uint8_t kind;
+  uint8_t bind;
+  uint16_t reserved0;
+  uint32_t section;
+  uint32_t reserved1;
+  uint64_t value;
+  uint64_t size;
+};
+
+struct reloc_entry {
+  uint64_t offset;
+  uint32_t symbol;
+  uint16_t type;
+  uint16_t reserved;
+  int64_t addend;
+};
+
+struct func_entry {
+  uint32_t symbol;
+  uint32_t section;
+  uint64_t offset;
+  uint64_t size;
+  uint8_t hash[32];
+  uint64_t reserved;
+};
+
+static_assert(sizeof(object_header) == 64 && sizeof(section_header) == 32 && sizeof(symbol_entry) == 32);
+static_assert(sizeof(reloc_entry) == 24 && sizeof(func_entry) == 64);
+
+inline constexpr uint8_t object_magic[4] = {0x43, 0x4F, 0x49, 0x4C};
+
+// 32-bit FNV-1a hash of a symbol name
+constexpr uint32_t coil_hash(std::string_view name) {
+  uint32_t h = 0x811C9DC5;
+  for (char c : name) h = (h ^ static_cast<uint8_t>(c)) * 0x01000193;
+  return h;
+}
+
+class object {
+ public:
+  explicit object(std::vector<uint8_t> bytes);
+  static object read_file(const std::string &path);
+
+  const object_header &header() const { return at<object_header>(0); }
+  uint32_t section_count() const { return header().section_count; }
+  const section_header &section(uint32_t index) const;
+  // The bytes of a section, empty for SECT_BSS
+  std::span<const uint8_t> contents(uint32_t index) const;
+
+  uint32_t symbol_count() const { return symbols_; }
+  const symbol_entry &symbol(uint32_t index) const;
+  std::string_view symbol_name(uint32_t index) const { return string(symbol(index).name); }
+  // A string of the string table
+  std::string_view string(uint32_t offset) const;
+  // Index of the global or weak symbol defined or referenced under name, 0
+  // when there is none. Uses the symbol hash table when the object has one.
+  uint32_t find(std::string_view name) const;
+
+  const std::vector<uint8_t> &bytes() const { return bytes_; }
+
+ private:
+  template <class T>
+  const T &at(uint64_t offset) const { return *reinterpret_cast<const T *>(bytes_.data() + offset); }
+
+  std::vector<uint8_t> bytes_;
+  uint32_t symbols_ = 0;
+  uint32_t symhash_ = 0;
+};
+
+// Writes objects, for assemblers and tests. Sections and symbols are given
+// in the order they are to appear, local symbols before global and weak
+// ones, and finish() lays out the file with a string table, a symbol table
+// and its hash table.
+class object_writer {
+ public:
+  object_writer();
+
+  uint32_t add_section(std::string_view name, uint16_t type, uint8_t align = 4, uint32_t flags = 0);
+  std::vector<uint8_t> &data(uint32_t section) { return sections_[section].data; }
+  void set_bss_size(uint32_t section, uint64_t size) { sections_[section].bss_size = size; }
+
+  uint32_t add_symbol(std::string_view name, uint8_t kind, uint8_t bind, uint32_t section = 0, uint64_t value = 0, uint64_t size = 0);
+  symbol_entry &symbol(uint32_t index) { return symbols_[index]; }
+  uint32_t symbol_count() const { return static_cast<uint32_t>(symbols_.size()); }
+
+  void add_reloc(uint32_t section, uint64_t offset, uint32_t symbol, uint16_t type, int64_t addend = 0);
+
+  std::vector<uint8_t> finish();
+
+ private:
+  struct pending {
+    section_header header{};
+    std::vector<uint8_t> data;
+    uint64_t bss_size = 0;
+  };
+
+  uint32_t add_string(std::string_view s);
+
+  std::vector<pending> sections_;
+  std::vector<symbol_entry> symbols_;
+  std::vector<uint8_t> strings_;
+  std::vector<std::pair<uint32_t, reloc_entry>> relocs_;
+};
+
+}  // namespace coil
+
+#endif
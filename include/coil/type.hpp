@@ -0,0 +1,282 @@
+// COIL type words (v1/type.md)
+//
+// A type word is 16 bits, the main type in the low byte and the type
+// extensions in the high byte. Every property of a main type is a pure
+// function of the main type, so they are held in one constexpr 256 entry
+// table and decoding a type never branches on its value (v1/impl.md).
+
+#ifndef COIL_TYPE_HPP
+#define COIL_TYPE_HPP
+
+#include <array>
+#include <cstdint>
+
+namespace coil {
+
+// Main types
+inline constexpr uint8_t TYPE_INT8    = 0x01;
+inline constexpr uint8_t TYPE_INT16   = 0x02;
+inline constexpr uint8_t TYPE_INT32   = 0x03;
+inline constexpr uint8_t TYPE_INT64   = 0x04;
+inline constexpr uint8_t TYPE_INT128  = 0x05;
+inline constexpr uint8_t TYPE_UNT8    = 0x10;
+inline constexpr uint8_t TYPE_UNT16   = 0x12;
+inline constexpr uint8_t TYPE_UNT32   = 0x13;
+inline constexpr uint8_t TYPE_UNT64   = 0x14;
+inline constexpr uint8_t TYPE_UNT128  = 0x15;
+inline constexpr uint8_t TYPE_FP8e5m2 = 0x20;
+inline constexpr uint8_t TYPE_FP8e4m3 = 0x21;
+inline constexpr uint8_t TYPE_FP16b   = 0x22;
+inline constexpr uint8_t TYPE_FP16    = 0x23;
+inline constexpr uint8_t TYPE_FP32t   = 0x24;
+inline constexpr uint8_t TYPE_FP32    = 0x25;
+inline constexpr uint8_t TYPE_FP64    = 0x26;
+inline constexpr uint8_t TYPE_FP80    = 0x27;
+inline constexpr uint8_t TYPE_FP128   = 0x28;
+inline constexpr uint8_t TYPE_V128    = 0x30;
+inline constexpr uint8_t TYPE_V256    = 0x31;
+inline constexpr uint8_t TYPE_V512    = 0x32;
+inline constexpr uint8_t TYPE_VS      = 0x33;
+inline constexpr uint8_t TYPE_TILE    = 0x38;
+inline constexpr uint8_t TYPE_BIT     = 0x40;
+inline constexpr uint8_t TYPE_VAR     = 0x90;
+inline constexpr uint8_t TYPE_SYM     = 0x91;
+inline constexpr uint8_t TYPE_RGP     = 0x92;
+inline constexpr uint8_t TYPE_RFP     = 0x93;
+inline constexpr uint8_t TYPE_RV      = 0x94;
+inline constexpr uint8_t TYPE_RS      = 0x95;
+inline constexpr uint8_t TYPE_SAR     = 0x96;
+inline constexpr uint8_t TYPE_SAF     = 0x97;
+inline constexpr uint8_t TYPE_SES     = 0x98;
+inline constexpr uint8_t TYPE_SS      = 0x99;
+inline constexpr uint8_t TYPE_IP      = 0x9A;
+inline constexpr uint8_t TYPE_SP      = 0x9B;
+inline constexpr uint8_t TYPE_BP      = 0x9C;
+inline constexpr uint8_t TYPE_INT     = 0xA0;
+inline constexpr uint8_t TYPE_UNT     = 0xA1;
+inline constexpr uint8_t TYPE_FP      = 0xA2;
+inline constexpr uint8_t TYPE_LINT    = 0xA3;
+inline constexpr uint8_t TYPE_LUNT    = 0xA4;
+inline constexpr uint8_t TYPE_LFP     = 0xA5;
+inline constexpr uint8_t TYPE_PTR     = 0xA6;
+inline constexpr uint8_t TYPE_PTRD    = 0xA7;
+inline constexpr uint8_t TYPE_PTRS    = 0xA8;
+inline constexpr uint8_t TYPE_PTRC    = 0xA9;
+inline constexpr uint8_t TYPE_PTRU    = 0xAA;
+inline constexpr uint8_t TYPE_CINT    = 0xB0;
+inline constexpr uint8_t TYPE_CUNT    = 0xB1;
+inline constexpr uint8_t TYPE_CFP     = 0xB2;
+inline constexpr uint8_t TYPE_STRUCT  = 0xD0;
+inline constexpr uint8_t TYPE_PACK    = 0xD1;
+inline constexpr uint8_t TYPE_UNION   = 0xD2;
+inline constexpr uint8_t TYPE_ARRAY   = 0xD3;
+inline constexpr uint8_t TYPE_PARAM5  = 0xF0;
+inline constexpr uint8_t TYPE_PARAM4  = 0xFA;
+inline constexpr uint8_t TYPE_PARAM3  = 0xFB;
+inline constexpr uint8_t TYPE_PARAM2  = 0xFC;
+inline constexpr uint8_t TYPE_PARAM1  = 0xFD;
+inline constexpr uint8_t TYPE_PARAM0  = 0xFE;
+inline constexpr uint8_t TYPE_VOID    = 0xFF;
+
+// Type extensions, the high byte of a type word
+inline constexpr uint8_t TYPEEXT_CONST    = 1 << 0;
+inline constexpr uint8_t TYPEEXT_VOLATILE = 1 << 1;
+inline constexpr uint8_t TYPEEXT_RESTRICT = 1 << 2;
+inline constexpr uint8_t TYPEEXT_VOID     = 1 << 4;
+inline constexpr uint8_t TYPEEXT_IMM      = 1 << 5;
+inline constexpr uint8_t TYPEEXT_VAR      = 1 << 6;
+inline constexpr uint8_t TYPEEXT_SYM      = 1 << 7;
+
+// Categories
+inline constexpr uint8_t TYPE_CAT_NONE      = 0x00;
+inline constexpr uint8_t TYPE_CAT_INT       = 0x01;
+inline constexpr uint8_t TYPE_CAT_UNT       = 0x02;
+inline constexpr uint8_t TYPE_CAT_FP        = 0x03;
+inline constexpr uint8_t TYPE_CAT_VEC       = 0x04;
+inline constexpr uint8_t TYPE_CAT_BIT       = 0x05;
+inline constexpr uint8_t TYPE_CAT_PTR       = 0x06;
+inline constexpr uint8_t TYPE_CAT_COMPLEX   = 0x07;
+inline constexpr uint8_t TYPE_CAT_SPECIAL   = 0x08;
+inline constexpr uint8_t TYPE_CAT_COMPOSITE = 0x09;
+inline constexpr uint8_t TYPE_CAT_PARAM     = 0x0A;
+inline constexpr uint8_t TYPE_CAT_VOID      = 0x0B;
+inline constexpr uint8_t TYPE_CAT_TILE      = 0x0C;
+
+// Register classes
+inline constexpr uint8_t REG_CLASS_NONE = 0x00;
+inline constexpr uint8_t REG_CLASS_GP   = 0x01;
+inline constexpr uint8_t REG_CLASS_FP   = 0x02;
+inline constexpr uint8_t REG_CLASS_V    = 0x03;
+inline constexpr uint8_t REG_CLASS_SEG  = 0x04;
+inline constexpr uint8_t REG_CLASS_TILE = 0x05;
+
+// Sizes and alignments of the property table that are not a byte count. No
+// real size exceeds 64 bytes, so the markers share the field with them.
+inline constexpr uint8_t SIZE_NONE       = 0x00;  // `-`, no storage
+inline constexpr uint8_t SIZE_PLATFORM   = 0xF0;  // `P`, set by the architecture target context
+inline constexpr uint8_t SIZE_DEFINITION = 0xF1;  // `D`, from the composite type definition
+inline constexpr uint8_t SIZE_RUNTIME    = 0xF2;  // `R`, only known at run time
+inline constexpr uint8_t SIZE_TSHAPE     = 0xF3;  // `T`, set by TSHAPE for each variable
+
+struct coil_type_info {
+  uint8_t category;   // TYPE_CAT_*
+  uint8_t size;       // size in bytes or SIZE_*
+  uint8_t align;      // alignment in bytes or SIZE_*
+  uint8_t reg_class;  // REG_CLASS_*
+};
+
+namespace detail {
+
+inline constexpr uint8_t P = SIZE_PLATFORM;
+inline constexpr uint8_t D = SIZE_DEFINITION;
+inline constexpr uint8_t R = SIZE_RUNTIME;
+inline constexpr uint8_t T = SIZE_TSHAPE;
+
+struct type_row {
+  uint8_t main;
+  coil_type_info info;
+};
+
+// The property table of v1/type.md, row for row
+inline constexpr type_row type_rows[] = {
+  {TYPE_INT8,     {TYPE_CAT_INT,       1,  1,  REG_CLASS_GP}},
+  {TYPE_INT16,    {TYPE_CAT_INT,       2,  2,  REG_CLASS_GP}},
+  {TYPE_INT32,    {TYPE_CAT_INT,       4,  4,  REG_CLASS_GP}},
+  {TYPE_INT64,    {TYPE_CAT_INT,       8,  8,  REG_CLASS_GP}},
+  {TYPE_INT128,   {TYPE_CAT_INT,       16, 16, REG_CLASS_GP}},
+  {TYPE_UNT8,     {TYPE_CAT_UNT,       1,  1,  REG_CLASS_GP}},
+  {TYPE_UNT16,    {TYPE_CAT_UNT,       2,  2,  REG_CLASS_GP}},
+  {TYPE_UNT32,    {TYPE_CAT_UNT,       4,  4,  REG_CLASS_GP}},
+  {TYPE_UNT64,    {TYPE_CAT_UNT,       8,  8,  REG_CLASS_GP}},
+  {TYPE_UNT128,   {TYPE_CAT_UNT,       16, 16, REG_CLASS_GP}},
+  {TYPE_FP8e5m2,  {TYPE_CAT_FP,        1,  1,  REG_CLASS_FP}},
+  {TYPE_FP8e4m3,  {TYPE_CAT_FP,        1,  1,  REG_CLASS_FP}},
+  {TYPE_FP16b,    {TYPE_CAT_FP,        2,  2,  REG_CLASS_FP}},
+  {TYPE_FP16,     {TYPE_CAT_FP,        2,  2,  REG_CLASS_FP}},
+  {TYPE_FP32t,    {TYPE_CAT_FP,        4,  4,  REG_CLASS_FP}},
+  {TYPE_FP32,     {TYPE_CAT_FP,        4,  4,  REG_CLASS_FP}},
+  {TYPE_FP64,     {TYPE_CAT_FP,        8,  8,  REG_CLASS_FP}},
+  {TYPE_FP80,     {TYPE_CAT_FP,        16, 16, REG_CLASS_FP}},
+  {TYPE_FP128,    {TYPE_CAT_FP,        16, 16, REG_CLASS_FP}},
+  {TYPE_V128,     {TYPE_CAT_VEC,       16, 16, REG_CLASS_V}},
+  {TYPE_V256,     {TYPE_CAT_VEC,       32, 32, REG_CLASS_V}},
+  {TYPE_V512,     {TYPE_CAT_VEC,       64, 64, REG_CLASS_V}},
+  {TYPE_VS,       {TYPE_CAT_VEC,       R,  16, REG_CLASS_V}},
+  {TYPE_TILE,     {TYPE_CAT_TILE,      T,  64, REG_CLASS_TILE}},
+  {TYPE_BIT,      {TYPE_CAT_BIT,       1,  1,  REG_CLASS_GP}},
+  {TYPE_VAR,      {TYPE_CAT_SPECIAL,   0,  0,  REG_CLASS_NONE}},
+  {TYPE_SYM,      {TYPE_CAT_SPECIAL,   P,  P,  REG_CLASS_GP}},
+  {TYPE_RGP,      {TYPE_CAT_SPECIAL,   P,  P,  REG_CLASS_GP}},
+  {TYPE_RFP,      {TYPE_CAT_SPECIAL,   P,  P,  REG_CLASS_FP}},
+  {TYPE_RV,       {TYPE_CAT_SPECIAL,   P,  P,  REG_CLASS_V}},
+  {TYPE_RS,       {TYPE_CAT_SPECIAL,   P,  P,  REG_CLASS_SEG}},
+  {TYPE_SAR,      {TYPE_CAT_SPECIAL,   P,  P,  REG_CLASS_NONE}},
+  {TYPE_SAF,      {TYPE_CAT_SPECIAL,   P,  P,  REG_CLASS_NONE}},
+  {TYPE_SES,      {TYPE_CAT_SPECIAL,   P,  P,  REG_CLASS_NONE}},
+  {TYPE_SS,       {TYPE_CAT_SPECIAL,   P,  P,  REG_CLASS_NONE}},
+  {TYPE_IP,       {TYPE_CAT_SPECIAL,   P,  P,  REG_CLASS_NONE}},
+  {TYPE_SP,       {TYPE_CAT_SPECIAL,   P,  P,  REG_CLASS_NONE}},
+  {TYPE_BP,       {TYPE_CAT_SPECIAL,   P,  P,  REG_CLASS_NONE}},
+  {TYPE_INT,      {TYPE_CAT_INT,       P,  P,  REG_CLASS_GP}},
+  {TYPE_UNT,      {TYPE_CAT_UNT,       P,  P,  REG_CLASS_GP}},
+  {TYPE_FP,       {TYPE_CAT_FP,        P,  P,  REG_CLASS_FP}},
+  {TYPE_LINT,     {TYPE_CAT_INT,       P,  P,  REG_CLASS_GP}},
+  {TYPE_LUNT,     {TYPE_CAT_UNT,       P,  P,  REG_CLASS_GP}},
+  {TYPE_LFP,      {TYPE_CAT_FP,        P,  P,  REG_CLASS_FP}},
+  {TYPE_PTR,      {TYPE_CAT_PTR,       P,  P,  REG_CLASS_GP}},
+  {TYPE_PTRD,     {TYPE_CAT_PTR,       P,  P,  REG_CLASS_GP}},
+  {TYPE_PTRS,     {TYPE_CAT_PTR,       P,  P,  REG_CLASS_GP}},
+  {TYPE_PTRC,     {TYPE_CAT_PTR,       P,  P,  REG_CLASS_GP}},
+  {TYPE_PTRU,     {TYPE_CAT_PTR,       P,  P,  REG_CLASS_GP}},
+  {TYPE_CINT,     {TYPE_CAT_COMPLEX,   P,  P,  REG_CLASS_GP}},
+  {TYPE_CUNT,     {TYPE_CAT_COMPLEX,   P,  P,  REG_CLASS_GP}},
+  {TYPE_CFP,      {TYPE_CAT_COMPLEX,   P,  P,  REG_CLASS_FP}},
+  {TYPE_STRUCT,   {TYPE_CAT_COMPOSITE, D,  D,  REG_CLASS_NONE}},
+  {TYPE_PACK,     {TYPE_CAT_COMPOSITE, D,  D,  REG_CLASS_NONE}},
+  {TYPE_UNION,    {TYPE_CAT_COMPOSITE, D,  D,  REG_CLASS_NONE}},
+  {TYPE_ARRAY,    {TYPE_CAT_COMPOSITE, D,  D,  REG_CLASS_NONE}},
+  {TYPE_PARAM0,   {TYPE_CAT_PARAM,     0,  0,  REG_CLASS_NONE}},
+  {TYPE_PARAM1,   {TYPE_CAT_PARAM,     0,  0,  REG_CLASS_NONE}},
+  {TYPE_PARAM2,   {TYPE_CAT_PARAM,     0,  0,  REG_CLASS_NONE}},
+  {TYPE_PARAM3,   {TYPE_CAT_PARAM,     0,  0,  REG_CLASS_NONE}},
+  {TYPE_PARAM4,   {TYPE_CAT_PARAM,     0,  0,  REG_CLASS_NONE}},
+  {TYPE_PARAM5,   {TYPE_CAT_PARAM,     0,  0,  REG_CLASS_NONE}},
+  {TYPE_VOID,     {TYPE_CAT_VOID,      0,  0,  REG_CLASS_NONE}},
+};
+
+constexpr std::array<coil_type_info, 256> make_type_table() {
+  std::array<coil_type_info, 256> table{};  // unlisted values are TYPE_CAT_NONE
+  for (const type_row &row : type_rows) table[row.main] = row.info;
+  return table;
+}
+
+}  // namespace detail
+
+inline constexpr std::array<coil_type_info, 256> coil_types = detail::make_type_table();
+
+constexpr uint8_t main_type(uint16_t word) { return static_cast<uint8_t>(word & 0xFF); }
+constexpr uint8_t type_ext(uint16_t word) { return static_cast<uint8_t>(word >> 8); }
+constexpr uint16_t type_word(uint8_t main, uint8_t ext = 0) { return static_cast<uint16_t>(main | ext << 8); }
+
+constexpr const coil_type_info &info(uint16_t word) { return coil_types[word & 0xFF]; }
+constexpr uint8_t category(uint16_t word) { return info(word).category; }
+constexpr uint8_t reg_class(uint16_t word) { return info(word).reg_class; }
+
+// A malformed main type is rejected with one test of the category
+constexpr bool is_valid(uint16_t word) { return category(word) != TYPE_CAT_NONE; }
+
+constexpr bool is_integer(uint16_t word) {
+  uint8_t c = category(word);
+  return c == TYPE_CAT_INT || c == TYPE_CAT_UNT;
+}
+
+constexpr bool has_fixed_size(uint16_t word) { return info(word).size != SIZE_NONE && info(word).size < SIZE_PLATFORM; }
+
+// Size of an immediate of a main type (v1/overview.md), 0 when the type can
+// not be an immediate. Platform dependent types have a fixed immediate form
+// of their own, independent of the target.
+constexpr uint8_t immediate_size(uint8_t main) {
+  switch (main) {
+  case TYPE_INT: case TYPE_UNT: case TYPE_LINT: case TYPE_LUNT:
+  case TYPE_PTR: case TYPE_PTRD: case TYPE_PTRS: case TYPE_PTRC: case TYPE_PTRU:
+  case TYPE_FP:
+    return 8;
+  case TYPE_LFP: case TYPE_CINT: case TYPE_CUNT: case TYPE_CFP:
+    return 16;
+  }
+  switch (coil_types[main].category) {
+  case TYPE_CAT_INT: case TYPE_CAT_UNT: case TYPE_CAT_FP: case TYPE_CAT_VEC: case TYPE_CAT_BIT:
+    return coil_types[main].size < SIZE_PLATFORM ? coil_types[main].size : 0;
+  }
+  return 0;
+}
+
+namespace detail {
+
+constexpr std::array<uint8_t, 256> make_immediate_sizes() {
+  std::array<uint8_t, 256> sizes{};
+  for (int main = 0; main < 256; main++) sizes[main] = immediate_size(static_cast<uint8_t>(main));
+  return sizes;
+}
+
+}  // namespace detail
+
+inline constexpr std::array<uint8_t, 256> immediate_sizes = detail::make_immediate_sizes();
+
+// Size of the value of an operand in the normal encoding, by the first
+// matching rule of v1/overview.md. The 4 byte type ID of a composite operand
+// is not included. Returns -1 for an immediate of a type that can not be one.
+constexpr int operand_value_size(uint16_t word) {
+  uint8_t main = main_type(word), ext = type_ext(word);
+  if (category(word) == TYPE_CAT_PARAM) return 1;
+  if ((ext & TYPEEXT_SYM) || main == TYPE_SYM) return 4;
+  if ((ext & TYPEEXT_VAR) || main == TYPE_VAR) return 4;
+  if (main >= TYPE_RGP && main <= TYPE_RS) return 1;
+  if ((main >= TYPE_SAR && main <= TYPE_BP) || main == TYPE_VOID) return 0;
+  if (ext & TYPEEXT_IMM) return immediate_sizes[main] ? immediate_sizes[main] : -1;
+  return 0;
+}
+
+}  // namespace coil
+
+#endif
@@ -0,0 +1,1354 @@
+// Decoding a function into records (v1/impl.md)
+//
+// The first pass reads every instruction and operand, gives each variable
+// its type and collects the TSHAPE of tiles. The second pass emits the
+// records, choosing the handler from the types of the operands, and turns
+// immediates and symbol addresses into constants in the frame so that every
+// operand a handler reads is a frame offset.
+//
+// The frame holds the variables, then the constants, which are copied in
+// from decoded::init when the frame is set up, then the temporaries of the
+// instruction being run, then the fixed SALLOC slots. Temporaries and slots
+// are laid out last, their offsets are marked with TEMP or SLOT until then.
+
+#include "engine_impl.hpp"
+
+#include <coil/isa.hpp>
+#include <coil/type.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+namespace coil::detail {
+
+namespace {
+
+constexpr uint32_t TEMP = 0x80000000, SLOT = 0x40000000, OFFSET = 0x3FFFFFFF;
+
+enum class okind : uint8_t { param, sym, var, imm, type };
+
+struct opnd {
+  okind kind = okind::type;
+  uint8_t main = 0;
+  uint8_t ext = 0;
+  uint32_t index = 0;  // symbol index, variable ID or parameter value
+  uint8_t size = 0;    // of an immediate
+  uint8_t imm[64] = {};
+};
+
+struct insn {
+  uint8_t op;
+  uint64_t offset;  // from the start of the function
+  std::vector<opnd> ops;
+};
+
+struct var_info {
+  uint8_t main = 0;
+  uint32_t offset = 0;
+  uint32_t size = 0;
+  uint32_t rows = 0, row_bytes = 0;  // TSHAPE of a tile
+  uint8_t lane = 0;
+};
+
+// Where a branch target has to be patched from an instruction index to a
+// record index
+struct fixup {
+  enum { RECORD, EXTRA, CASE } where;
+  uint32_t index;
+  uint8_t field;
+};
+
+std::string hex(uint64_t v) {
+  static const char digits[] = "0123456789ABCDEF";
+  std::string s;
+  do s.insert(s.begin(), digits[v & 15]); while (v >>= 4);
+  return "0x" + s;
+}
+
+bool is_control(uint8_t op) { return op == BR || op == RET || op == SWITCH || op == SWITCHS || op == BRI; }
+
+// The engine is a 64-bit target, TYPE_FP is a TYPE_FP64
+kind kind_of(uint8_t main) {
+  switch (main) {
+    case TYPE_INT8: return K_I8;
+    case TYPE_INT16: return K_I16;
+    case TYPE_INT32: return K_I32;
+    case TYPE_INT64: case TYPE_INT: case TYPE_LINT: return K_I64;
+    case TYPE_INT128: return K_I128;
+    case TYPE_UNT8: case TYPE_BIT: return K_U8;
+    case TYPE_UNT16: return K_U16;
+    case TYPE_UNT32: return K_U32;
+    case TYPE_UNT64: case TYPE_UNT: case TYPE_LUNT: return K_U64;
+    case TYPE_PTR: case TYPE_PTRD: case TYPE_PTRS: case TYPE_PTRC: case TYPE_PTRU: case TYPE_SYM: return K_U64;
+    case TYPE_UNT128: return K_U128;
+    case TYPE_FP32: return K_F32;
+    case TYPE_FP64: case TYPE_FP: return K_F64;
+    case TYPE_FP16b: return K_BF16;
+    default: return K_NONE;
+  }
+}
+
+bool is_int(kind k) { return k < K_F32; }
+bool is_fp(kind k) { return k == K_F32 || k == K_F64; }
+bool is_signed(kind k) { return k <= K_I128; }
+int kind_size(kind k) {
+  static constexpr int sizes[] = {1, 2, 4, 8, 16, 1, 2, 4, 8, 16, 4, 8, 2, 0};
+  return sizes[k];
+}
+
+// Index in the 8 entry families of integers up to 64 bits, -1 otherwise
+int int64_index(kind k) { return k <= K_I64 ? k : k >= K_U8 && k <= K_U64 ? k - 1 : -1; }
+int lane_index(kind k) { return is_fp(k) ? 8 + (k - K_F32) : int64_index(k); }
+
+int size_index(uint32_t size) {
+  switch (size) {
+    case 1: return 0;
+    case 2: return 1;
+    case 4: return 2;
+    case 8: return 3;
+    case 16: return 4;
+    case 32: return 5;
+    case 64: return 6;
+    default: return -1;
+  }
+}
+
+uint16_t h(handler base, int index) { return static_cast<uint16_t>(base + index); }
+
+class decoder {
+ public:
+  decoder(engine::image &img, function &fn) : img_(img), obj_(img.object), fn_(fn) {}
+
+  std::unique_ptr<decoded> run() {
+    out_ = std::make_unique<decoded>();
+    parse();
+    type_variables();
+    find_loops();
+    layout_variables();
+
+    first_.resize(insns_.size() + 1);
+    for (size_t i = 0; i < insns_.size(); i++) {
+      at_ = i;
+      first_[i] = static_cast<uint32_t>(out_->code.size());
+      temp_ = 0;
+      emit(insns_[i], i);
+      for (const auto &[t, address, size] : stores_) add(h(H_STORE_1, size_index(size)), {address, t});
+      stores_.clear();
+    }
+    first_[insns_.size()] = static_cast<uint32_t>(out_->code.size());
+    finish();
+    return std::move(out_);
+  }
+
+ private:
+  [[noreturn]] void fail(const std::string &what) const {
+    std::string where = at_ < insns_.size() ? " at offset " + hex(insns_[at_].offset) : "";
+    throw error("engine: " + fn_.name + where + ": " + what);
+  }
+
+  // First pass
+
+  void parse() {
+    const section_header &sh = obj_.section(fn_.section);
+    std::span<const uint8_t> code = obj_.contents(fn_.section);
+    if (fn_.offset > code.size() || fn_.size > code.size() - fn_.offset) fail("function outside its section");
+    const uint8_t *base = code.data() + fn_.offset;
+    bool compact = sh.flags & SECT_FLAG_COMPACT;
+    size_t pos = 0, end = fn_.size;
+
+    auto need = [&](size_t n, size_t limit) {
+      if (n > limit - pos) fail("instruction runs past its end");
+    };
+    auto uleb = [&](size_t limit) {
+      u128 v = 0;
+      for (unsigned shift = 0;; shift += 7) {
+        need(1, limit);
+        uint8_t b = base[pos++];
+        if (shift >= 128 || (shift == 126 && b > 3)) fail("ULEB128 value too large");
+        v |= static_cast<u128>(b & 0x7F) << shift;
+        if (!(b & 0x80)) return v;
+      }
+    };
+    auto u32v = [&](size_t limit) -> uint32_t {
+      if (compact) {
+        u128 v = uleb(limit);
+        if (v > UINT32_MAX) fail("index does not fit 32 bits");
+        return static_cast<uint32_t>(v);
+      }
+      need(4, limit);
+      uint32_t v;
+      std::memcpy(&v, base + pos, 4);
+      pos += 4;
+      return v;
+    };
+
+    while (pos < end) {
+      insn in;
+      size_t start = pos;
+      at_ = insns_.size();
+      need(2, end);
+      in.op = base[pos];
+      in.offset = pos;
+      uint8_t count = base[pos + 1];
+      pos += 2;
+      size_t length;
+      if (compact) {
+        u128 l = uleb(end);
+        length = static_cast<size_t>(l);
+        if (l > 65532) fail("instruction longer than 65532 bytes");
+      } else {
+        need(2, end);
+        length = base[pos] | base[pos + 1] << 8;
+        pos += 2;
+        if (length < 4 || length % 4 != 0) fail("instruction length is not a multiple of 4");
+      }
+      if (length > end - start || length < pos - start) fail("instruction runs past the end of the function");
+      size_t limit = start + length;
+      insns_.push_back(in);
+
+      for (unsigned i = 0; i < count; i++) {
+        opnd o;
+        need(2, limit);
+        uint16_t word = base[pos] | base[pos + 1] << 8;
+        pos += 2;
+        o.main = main_type(word);
+        o.ext = type_ext(word);
+        uint8_t cat = category(o.main);
+        if (cat == TYPE_CAT_PARAM) {
+          need(1, limit);
+          o.kind = okind::param;
+          o.index = base[pos++];
+        } else if ((o.ext & TYPEEXT_SYM) || o.main == TYPE_SYM) {
+          o.kind = okind::sym;
+          o.index = u32v(limit);
+        } else if ((o.ext & TYPEEXT_VAR) || o.main == TYPE_VAR) {
+          o.kind = okind::var;
+          o.index = u32v(limit);
+        } else if (cat == TYPE_CAT_SPECIAL && o.main != TYPE_VAR && o.main != TYPE_SYM) {
+          fail("register operands are not supported");
+        } else if (o.ext & TYPEEXT_IMM) {
+          o.kind = okind::imm;
+          o.size = immediate_size(o.main);
+          if (o.size == 0 || o.size > sizeof o.imm) fail("main type " + hex(o.main) + " can not be an immediate");
+          uint8_t c = category(o.main);
+          if (compact && (c == TYPE_CAT_INT || c == TYPE_CAT_UNT || c == TYPE_CAT_PTR || c == TYPE_CAT_BIT)) {
+            u128 v = uleb(limit);
+            if (c == TYPE_CAT_INT) v = (v >> 1) ^ (~(v & 1) + 1);
+            std::memcpy(o.imm, &v, o.size);
+            u128 back = 0;
+            std::memcpy(&back, o.imm, o.size);
+            if (c == TYPE_CAT_INT && o.size < 16 && (o.imm[o.size - 1] & 0x80)) back |= ~u128{0} << (8 * o.size);
+            if (back != v) fail("compact immediate does not fit its type");
+          } else {
+            need(o.size, limit);
+            std::memcpy(o.imm, base + pos, o.size);
+            pos += o.size;
+          }
+        }
+        if (cat == TYPE_CAT_COMPOSITE || o.main == TYPE_ARRAY) fail("composite types are not supported");
+        insns_.back().ops.push_back(o);
+      }
+      pos = limit;
+    }
+    if (insns_.empty()) fail("function is empty");
+    at_ = insns_.size() - 1;
+    const insn &last = insns_.back();
+    if (!is_control(last.op) && !(last.op == CALL && tail_call(last))) fail("function does not end with a control flow instruction");
+    if (last.op == BR && last.ops.size() > 1 && last.ops[1].kind == okind::param) fail("function ends with a conditional branch");
+  }
+
+  static bool tail_call(const insn &in) {
+    for (size_t i = 1; i < in.ops.size(); i++)
+      if (in.ops[i].kind == okind::param && in.ops[i].index == BRANCH_CTRL_TAIL) return true;
+    return false;
+  }
+
+  void type_variables() {
+    std::vector<const opnd *> untyped;
+    for (size_t i = 0; i < insns_.size(); i++) {
+      at_ = i;
+      for (const opnd &o : insns_[i].ops) {
+        if (o.kind == okind::imm || (o.kind == okind::sym && o.main != TYPE_SYM)) check_type(o.main);
+        if (o.kind != okind::var) continue;
+        if (o.main == TYPE_VAR) {
+          untyped.push_back(&o);
+          continue;
+        }
+        check_type(o.main);
+        var_info &v = vars_[o.index];
+        if (v.main && v.main != o.main) fail("variable " + std::to_string(o.index) + " is used with two types");
+        v.main = o.main;
+      }
+      const insn &in = insns_[i];
+      if (in.op == TSHAPE) {
+        if (in.ops.size() < 4 || in.ops[0].kind != okind::var) fail("TSHAPE needs a tile, rows, row bytes and a lane type");
+        var_info &v = vars_[in.ops[0].index];
+        v.rows = static_cast<uint32_t>(imm_value(in.ops[1]));
+        v.row_bytes = static_cast<uint32_t>(imm_value(in.ops[2]));
+        v.lane = in.ops[3].main;
+        if (v.rows < 1 || v.rows > 64 || v.row_bytes < 4 || v.row_bytes > 64 || v.rows * v.row_bytes > 1024) fail("bad TSHAPE");
+      }
+      for (const opnd &o : in.ops)
+        if ((in.op == BR || in.op == SEL) && o.kind == okind::param && o.index >= BRANCH_COND_Z && o.index <= BRANCH_COND_NS)
+          reads_zsco_ = true;
+    }
+    for (const opnd *o : untyped)
+      if (!vars_.count(o->index) || !vars_[o->index].main) fail("variable " + std::to_string(o->index) + " has no type");
+  }
+
+  void check_type(uint8_t main) const {
+    uint8_t cat = category(main);
+    if (main == TYPE_SYM || main == TYPE_VS || main == TYPE_TILE) return;
+    if (kind_of(main) != K_NONE || (cat == TYPE_CAT_VEC && info(main).size <= 64)) return;
+    if (cat == TYPE_CAT_PARAM || cat == TYPE_CAT_VOID || cat == TYPE_CAT_NONE) return;
+    fail("type " + hex(main) + " is not supported");
+  }
+
+  // An instruction is in a loop when a branch at or after it goes back to or
+  // before it
+  void find_loops() {
+    offsets_.reserve(insns_.size());
+    for (const insn &in : insns_) offsets_.push_back(in.offset);
+    in_loop_.assign(insns_.size(), false);
+    for (size_t j = 0; j < insns_.size(); j++) {
+      at_ = j;
+      const insn &in = insns_[j];
+      if (in.op != BR && in.op != SWITCH && in.op != SWITCHS && in.op != BRI) continue;
+      for (const opnd &o : in.ops) {
+        if (o.kind != okind::sym || o.main != TYPE_SYM) continue;
+        uint32_t t = target_insn(o);
+        if (t <= j) std::fill(in_loop_.begin() + t, in_loop_.begin() + j + 1, true);
+      }
+    }
+  }
+
+  void layout_variables() {
+    std::vector<uint32_t> ids;
+    for (auto &[id, v] : vars_) ids.push_back(id);
+    std::sort(ids.begin(), ids.end());
+    uint32_t offset = 0;
+    for (uint32_t id : ids) {
+      var_info &v = vars_[id];
+      if (v.main == TYPE_TILE) {
+        if (!v.rows) fail("tile variable " + std::to_string(id) + " has no TSHAPE");
+        v.size = v.rows * v.row_bytes;
+      } else {
+        v.size = type_size(v.main);
+      }
+      uint32_t align = v.size >= 64 ? 64 : std::bit_ceil(v.size);
+      offset = (offset + align - 1) & ~(align - 1);
+      v.offset = offset;
+      offset += v.size;
+      if (offset > OFFSET) fail("frame too large");
+    }
+    consts_ = out_->init_begin = (offset + 15) & ~15u;
+  }
+
+  // Types and operands
+
+  static uint32_t type_size(uint8_t main) {
+    switch (main) {
+      case TYPE_VS: return 64;
+      default: {
+        kind k = kind_of(main);
+        if (k != K_NONE) return kind_size(k);
+        return info(main).size;
+      }
+    }
+  }
+
+  const var_info &var(const opnd &o) const {
+    auto it = vars_.find(o.index);
+    return it->second;
+  }
+
+  // The main type of a value operand, TYPE_PTR for the address of a symbol
+  uint8_t type(const opnd &o) const {
+    switch (o.kind) {
+      case okind::var: return var(o).main;
+      case okind::sym: return o.main == TYPE_SYM ? TYPE_PTR : o.main;
+      case okind::imm: return o.main;
+      default: return o.main;
+    }
+  }
+
+  uint32_t size(const opnd &o) const { return o.kind == okind::var ? var(o).size : type_size(type(o)); }
+
+  bool is_value(const opnd &o) const { return o.kind == okind::var || o.kind == okind::sym || o.kind == okind::imm; }
+
+  const opnd &op(const insn &in, size_t i) const {
+    if (i >= in.ops.size()) fail("too few operands");
+    return in.ops[i];
+  }
+
+  uint8_t param(const insn &in, size_t i) const {
+    const opnd &o = op(in, i);
+    if (o.kind != okind::param) fail("operand " + std::to_string(i) + " must be a parameter");
+    return static_cast<uint8_t>(o.index);
+  }
+
+  bool has_param(const insn &in, size_t i) const { return i < in.ops.size() && in.ops[i].kind == okind::param; }
+
+  uint8_t lane(const insn &in, size_t i) const {
+    const opnd &o = op(in, i);
+    if (o.kind != okind::type) fail("operand " + std::to_string(i) + " must be a lane type");
+    if (kind_of(o.main) == K_NONE || kind_of(o.main) == K_I128 || kind_of(o.main) == K_U128 || o.main == TYPE_BIT)
+      fail("lane type " + hex(o.main) + " is not supported");
+    return o.main;
+  }
+
+  // The value of an integer immediate, sign extended from a TYPE_INT
+  int64_t imm_value(const opnd &o) const {
+    if (o.kind != okind::imm || !is_int(kind_of(o.main))) fail("operand must be an integer immediate");
+    u128 v = 0;
+    std::memcpy(&v, o.imm, o.size);
+    if (is_signed(kind_of(o.main)) && o.size < 16 && (o.imm[o.size - 1] & 0x80)) v |= ~u128{0} << (8 * o.size);
+    return static_cast<int64_t>(v);
+  }
+
+  uint32_t constant(const void *bytes, size_t n) {
+    // Padded to 8 bytes, so a slightly narrower argument still reads zeros
+    std::string key(static_cast<const char *>(bytes), n);
+    key.resize(std::max<size_t>(n, 8), '\0');
+    auto it = constants_.find(key);
+    if (it != constants_.end()) return it->second;
+    uint32_t align = key.size() >= 64 ? 64 : std::bit_ceil(static_cast<uint32_t>(key.size()));
+    consts_ = (consts_ + align - 1) & ~(align - 1);
+    uint32_t offset = consts_;
+    consts_ += static_cast<uint32_t>(key.size());
+    if (consts_ > OFFSET) fail("frame too large");
+    out_->init.resize(consts_ - out_->init_begin);
+    std::memcpy(out_->init.data() + (offset - out_->init_begin), key.data(), key.size());
+    constants_.emplace(std::move(key), offset);
+    return offset;
+  }
+
+  uint32_t constant_u64(uint64_t v) { return constant(&v, 8); }
+
+  uint32_t temp(uint32_t n) {
+    uint32_t align = n >= 64 ? 64 : 16;
+    temp_ = (temp_ + align - 1) & ~(align - 1);
+    uint32_t t = temp_;
+    temp_ += n;
+    temps_ = std::max(temps_, temp_);
+    return TEMP | t;
+  }
+
+  uint32_t address(const opnd &o) {
+    try {
+      return constant_u64(img_.address(o.index));
+    } catch (const error &e) {
+      fail(e.what());
+    }
+  }
+
+  // The frame offset holding the value of a source operand
+  uint32_t src(const opnd &o) {
+    switch (o.kind) {
+      case okind::var: return var(o).offset;
+      case okind::imm: return constant(o.imm, o.size);
+      case okind::sym: {
+        if (o.main == TYPE_SYM) return address(o);
+        uint32_t n = type_size(o.main), t = temp(n);
+        int s = size_index(n);
+        if (s < 0) fail("memory operand of size " + std::to_string(n));
+        add(h(H_LOAD_1, s), {t, address(o)});
+        return t;
+      }
+      default: fail("operand is not a value");
+    }
+  }
+
+  // A source taken as main, converting immediates and widening integers of
+  // another size such as the integer added to a pointer
+  uint32_t src_as(const opnd &o, uint8_t main) {
+    kind to = kind_of(main), from = kind_of(type(o));
+    if (to == K_NONE || from == K_NONE || from == to || (is_int(from) && is_int(to) && kind_size(from) == kind_size(to))) return src(o);
+    if (o.kind == okind::imm) {
+      uint8_t bytes[16] = {};
+      convert_imm(o, from, to, bytes);
+      return constant(bytes, kind_size(to));
+    }
+    if (is_int(from) && is_int(to)) return convert(src(o), to, from);
+    return src(o);
+  }
+
+  static void convert_imm(const opnd &o, kind from, kind to, uint8_t *out) {
+    u128 u = 0;
+    std::memcpy(&u, o.imm, o.size);
+    if (is_signed(from) && o.size < 16 && (o.imm[o.size - 1] & 0x80)) u |= ~u128{0} << (8 * o.size);
+    double d = 0;
+    if (from == K_F32) {
+      float f;
+      std::memcpy(&f, o.imm, 4);
+      d = f;
+    } else if (from == K_F64) {
+      std::memcpy(&d, o.imm, 8);
+    } else if (is_signed(from)) {
+      d = static_cast<double>(static_cast<i128>(u));
+    } else {
+      d = static_cast<double>(u);
+    }
+    if (is_int(to)) {
+      if (is_fp(from)) u = is_signed(to) ? static_cast<u128>(static_cast<i128>(std::trunc(d))) : static_cast<u128>(std::trunc(d));
+      std::memcpy(out, &u, kind_size(to));
+    } else if (to == K_F32) {
+      float f = static_cast<float>(d);
+      std::memcpy(out, &f, 4);
+    } else if (to == K_F64) {
+      std::memcpy(out, &d, 8);
+    }
+  }
+
+  // CVT of the value at offset into a temporary of kind to
+  uint32_t convert(uint32_t offset, kind to, kind from) {
+    uint32_t t = temp(kind_size(to));
+    add(h(H_CVT_i8_i8, 13 * to + from), {t, offset});
+    return t;
+  }
+
+  // An unsigned count or length as a TYPE_UNT64, signed integers extended
+  // by their sign
+  uint32_t count(const opnd &o) {
+    kind k = kind_of(type(o));
+    if (!is_int(k)) fail("count must be an integer");
+    if (o.kind == okind::imm) return constant_u64(static_cast<uint64_t>(imm_value(o)));
+    if (kind_size(k) == 8) return src(o);
+    return convert(src(o), K_U64, k);
+  }
+
+  // The frame offset a destination operand is written to. A memory operand
+  // is written to a temporary and stored after the record.
+  uint32_t dst(const opnd &o) {
+    if (o.kind == okind::var) return var(o).offset;
+    if (o.kind == okind::sym && o.main != TYPE_SYM) {
+      uint32_t n = type_size(o.main), t = temp(n);
+      if (size_index(n) < 0) fail("memory operand of size " + std::to_string(n));
+      stores_.push_back({t, address(o), n});
+      return t;
+    }
+    fail("destination is not a variable");
+  }
+
+  uint32_t target_insn(const opnd &o) const {
+    if (o.kind != okind::sym || o.main != TYPE_SYM) fail("branch target must be a TYPE_SYM operand");
+    const symbol_entry &s = obj_.symbol(o.index);
+    if (s.section != fn_.section || s.value < fn_.offset || s.value >= fn_.offset + fn_.size)
+      fail("branch target " + std::string(obj_.symbol_name(o.index)) + " is not inside the function");
+    auto it = std::lower_bound(offsets_.begin(), offsets_.end(), s.value - fn_.offset);
+    if (it == offsets_.end() || *it != s.value - fn_.offset) fail("branch target is not at an instruction");
+    return static_cast<uint32_t>(it - offsets_.begin());
+  }
+
+  uint32_t add(uint16_t handler, std::initializer_list<uint32_t> a, uint8_t aux = 0, uint8_t mode = 0, uint32_t n = 0) {
+    record r{};
+    r.op = handler;
+    r.aux = aux;
+    r.mode = mode;
+    r.n = n;
+    std::copy(a.begin(), a.end(), r.a);
+    out_->code.push_back(r);
+    return static_cast<uint32_t>(out_->code.size() - 1);
+  }
+
+  void branch(uint32_t record, uint8_t field, const opnd &o) {
+    out_->code[record].a[field] = target_insn(o);
+    fixups_.push_back({fixup::RECORD, record, field});
+  }
+
+  function *callee(uint32_t symbol) const {
+    function *fn = img_.callee(symbol);
+    if (!fn) fail("call of " + std::string(obj_.symbol_name(symbol)) + ", which is not a function");
+    return fn;
+  }
+
+  // Second pass
+
+  struct vector_info {
+    uint32_t bytes;
+    uint8_t mode;
+  };
+
+  vector_info vec(const opnd &o) const {
+    uint8_t t = type(o);
+    if (category(t) != TYPE_CAT_VEC) fail("operand must be a vector");
+    return {size(o), static_cast<uint8_t>(t == TYPE_VS ? MODE_VS : 0)};
+  }
+
+  uint32_t lanes_of(const vector_info &v, uint8_t lane_type) const {
+    uint32_t ls = type_size(lane_type);
+    if (v.bytes % ls != 0) fail("lane type does not divide the vector");
+    return v.bytes / ls;
+  }
+
+  // MEMORY_CTRL parameters from operand i, returns the MEMORY_ORDER of an
+  // atomic access or -1
+  int memory_ctrl(const insn &in, size_t i) const {
+    int atomic = -1;
+    while (i < in.ops.size()) {
+      uint8_t p = param(in, i++);
+      if (p == MEMORY_CTRL_ATOMIC) atomic = param(in, i++);
+      else if (p == MEMORY_CTRL_ALIGNED) i++;
+    }
+    return atomic;
+  }
+
+  void emit(const insn &in, size_t index) {
+    const auto &o = in.ops;
+    switch (in.op) {
+      case NOP:
+      case TYPEDEF:
+      case TSHAPE:
+      case DIR_HINT:
+      case DIR_PROFILE:
+      case DIR_ABI:
+      case DIR_PU:
+      case DIR_ARCH:
+      case DIR_ASSUME:
+      case DIR_VERSION:
+      case DIR_KERNEL:
+      case DIR_SPACE:
+      case DIR_PARALLEL:
+      case DIR_LIFE:
+      case DIR_REGION:
+        return;
+
+      case ENTER: {
+        size_t i = 0;
+        if (has_param(in, 0) && param(in, 0) == BRANCH_CTRL_ABI) i = 2;
+        if (index != 0) fail("ENTER is not the first instruction");
+        for (; i < o.size(); i++) {
+          if (o[i].kind != okind::var) fail("ENTER takes variables");
+          out_->params.push_back({var(o[i]).offset, var(o[i]).size});
+        }
+        return;
+      }
+
+      case BR:
+        if (has_param(in, 1)) {
+          uint8_t cond = param(in, 1);
+          if (cond > BRANCH_COND_NS) fail("bad BRANCH_COND");
+          branch(add(H_BR_COND, {0}, cond), 0, op(in, 0));
+        } else {
+          branch(add(H_BR, {0}), 0, op(in, 0));
+        }
+        return;
+
+      case CALL: return emit_call(in);
+
+      case RET: {
+        std::vector<uint32_t> values;
+        for (const opnd &v : o) {
+          values.push_back(src(v));
+          values.push_back(size(v));
+        }
+        uint32_t first = static_cast<uint32_t>(out_->extra.size());
+        out_->extra.insert(out_->extra.end(), values.begin(), values.end());
+        add(H_RET, {first}, 0, 0, static_cast<uint32_t>(o.size()));
+        return;
+      }
+
+      case SWITCH: {
+        uint32_t n = size(op(in, 0));
+        if (n > 8 || size_index(n) < 0 || !is_int(kind_of(type(o[0])))) fail("SWITCH index must be an integer of up to 64 bits");
+        uint32_t index_slot = src(o[0]), low = src_as(op(in, 1), type(o[0]));
+        uint32_t first = static_cast<uint32_t>(out_->extra.size());
+        for (size_t i = 2; i < o.size(); i++) {
+          fixups_.push_back({fixup::EXTRA, static_cast<uint32_t>(out_->extra.size()), 0});
+          out_->extra.push_back(target_insn(o[i]));
+        }
+        if (o.size() < 3) fail("SWITCH without a default");
+        add(h(H_SWITCH_1, size_index(n)), {index_slot, low, first}, 0, 0, static_cast<uint32_t>(o.size() - 3));
+        return;
+      }
+
+      case SWITCHS: {
+        kind k = kind_of(type(op(in, 0)));
+        uint32_t n = kind_size(k);
+        if (!is_int(k) || n > 8) fail("SWITCHS value must be an integer of up to 64 bits");
+        if (o.size() < 2 || o.size() % 2 != 0) fail("SWITCHS needs a default and pairs of a case and a target");
+        uint32_t first = static_cast<uint32_t>(out_->cases.size());
+        for (size_t i = 2; i < o.size(); i += 2) {
+          uint64_t key = static_cast<uint64_t>(imm_value(o[i]));
+          if (is_signed(k)) key ^= uint64_t{1} << 63;
+          else if (n < 8) key &= (uint64_t{1} << (8 * n)) - 1;
+          out_->cases.push_back({key, target_insn(o[i + 1])});
+        }
+        std::sort(out_->cases.begin() + first, out_->cases.end());
+        for (size_t i = first; i < out_->cases.size(); i++) {
+          fixups_.push_back({fixup::CASE, static_cast<uint32_t>(i), 0});
+          if (i > first && out_->cases[i].first == out_->cases[i - 1].first) fail("SWITCHS cases are not distinct");
+        }
+        uint32_t r = add(H_SWITCHS, {src(o[0]), first, 0}, static_cast<uint8_t>(n), is_signed(k), static_cast<uint32_t>((o.size() - 2) / 2));
+        branch(r, 2, o[1]);
+        return;
+      }
+
+      case BADDR: branch(add(H_BADDR, {dst(op(in, 0)), 0}), 1, op(in, 1)); return;
+
+      case BRI: add(H_BRI, {src(op(in, 0))}); return;
+
+      case MOV: {
+        uint8_t t = type(op(in, 0));
+        int s = size_index(size(o[0]));
+        if (s < 0) fail("MOV of size " + std::to_string(size(o[0])));
+        uint32_t from = src_as(op(in, 1), t);
+        add(h(H_MOV_1, s), {dst(o[0]), from});
+        return;
+      }
+
+      case LOAD: {
+        int s = size_index(size(op(in, 0)));
+        if (s < 0) fail("LOAD of size " + std::to_string(size(o[0])));
+        uint32_t p = src(op(in, 1));
+        int atomic = memory_ctrl(in, 2);
+        if (atomic >= 0) {
+          if (s > 3) fail("atomic access wider than 8 bytes");
+          add(h(H_LOADA_1, s), {dst(o[0]), p}, static_cast<uint8_t>(atomic));
+        } else {
+          add(h(H_LOAD_1, s), {dst(o[0]), p});
+        }
+        return;
+      }
+
+      case STORE: {
+        int s = size_index(size(op(in, 1)));
+        if (s < 0) fail("STORE of size " + std::to_string(size(o[1])));
+        uint32_t p = src(op(in, 0)), v = src(o[1]);
+        int atomic = memory_ctrl(in, 2);
+        if (atomic >= 0) {
+          if (s > 3) fail("atomic access wider than 8 bytes");
+          add(h(H_STOREA_1, s), {p, v}, static_cast<uint8_t>(atomic));
+        } else {
+          add(h(H_STORE_1, s), {p, v});
+        }
+        return;
+      }
+
+      case XCHG: {
+        uint8_t t = type(op(in, 0));
+        int s = size_index(size(o[0]));
+        if (s < 0 || s > 3) fail("atomic access wider than 8 bytes");
+        uint32_t p = src(op(in, 1)), v = src_as(op(in, 2), t);
+        uint8_t order = has_param(in, 3) ? param(in, 3) : MEMORY_ORDER_SEQ_CST;
+        add(h(H_XCHG_1, s), {dst(o[0]), p, v}, order);
+        return;
+      }
+
+      case CAS: {
+        uint8_t t = type(op(in, 0));
+        int s = size_index(size(o[0]));
+        if (s < 0 || s > 3) fail("atomic access wider than 8 bytes");
+        uint32_t p = src(op(in, 1)), e = src_as(op(in, 2), t), d = src_as(op(in, 3), t);
+        uint8_t success = has_param(in, 4) ? param(in, 4) : MEMORY_ORDER_SEQ_CST;
+        uint8_t failure = success == MEMORY_ORDER_ACQ_REL ? MEMORY_ORDER_ACQUIRE : success == MEMORY_ORDER_RELEASE ? MEMORY_ORDER_RELAXED : success;
+        if (has_param(in, 5)) failure = param(in, 5);
+        if (failure == MEMORY_ORDER_RELEASE || failure == MEMORY_ORDER_ACQ_REL || failure > success) fail("bad CAS failure ordering");
+        bool weak = has_param(in, 6) && param(in, 6) == CAS_WEAK;
+        add(h(H_CAS_1, s), {dst(o[0]), p, e, d}, success, failure, weak);
+        return;
+      }
+
+      case FETCH: {
+        const opnd &value = op(in, 2);
+        uint8_t t = value.kind == okind::imm ? type(op(in, 0)) : type(value);
+        int k = int64_index(kind_of(t));
+        uint8_t fop = param(in, 3);
+        if (k < 0) fail("FETCH of type " + hex(t));
+        if (fop > FETCH_OP_MAX) fail("bad FETCH_OP");
+        uint32_t p = src(op(in, 1)), v = src_as(value, t);
+        uint8_t order = has_param(in, 4) ? param(in, 4) : MEMORY_ORDER_SEQ_CST;
+        add(h(H_FETCH_ADD_i8, 8 * fop + k), {dst(o[0]), p, v}, order);
+        return;
+      }
+
+      case FENCE: {
+        uint8_t order = param(in, 0);
+        if (order == MEMORY_ORDER_RELAXED) fail("FENCE with MEMORY_ORDER_RELAXED");
+        add(H_FENCE, {}, order, has_param(in, 1) ? param(in, 1) : FENCE_SCOPE_THREAD);
+        return;
+      }
+
+      case PREFETCH: add(H_PREFETCH, {src(op(in, 0))}, param(in, 1)); return;
+
+      case CACHE:
+        if (param(in, 1) == CACHE_OP_ZERO) add(H_CACHE_ZERO, {src(op(in, 0))});
+        return;
+
+      case MCOPY:
+      case MMOVE:
+      case MFILL: {
+        if (o.size() < 3 || o[2].kind == okind::param) fail("a length is needed without array types");
+        uint32_t d = src(o[0]), s = src(o[1]), n = count(o[2]);
+        add(in.op == MCOPY ? H_MCOPY : in.op == MMOVE ? H_MMOVE : H_MFILL, {d, s, n});
+        return;
+      }
+
+      case MCMP: {
+        if (o.size() < 4 || o[3].kind == okind::param) fail("a length is needed without array types");
+        uint32_t p1 = src(o[1]), p2 = src(o[2]), n = count(o[3]);
+        add(H_MCMP, {dst(o[0]), p1, p2, n}, static_cast<uint8_t>(size(o[0])));
+        return;
+      }
+
+      case SALLOC: {
+        uint64_t align = o.size() > 2 ? static_cast<uint64_t>(imm_value(o[2])) : 16;
+        if (align == 0 || (align & (align - 1)) != 0) fail("SALLOC alignment is not a power of two");
+        const opnd &n = op(in, 1);
+        if (n.kind == okind::imm && !in_loop_[index] && align <= 64) {
+          uint64_t bytes = static_cast<uint64_t>(imm_value(n));
+          slots_ = static_cast<uint32_t>((slots_ + align - 1) & ~(align - 1));
+          uint32_t slot = slots_;
+          if (bytes > OFFSET - slots_) fail("frame too large");
+          slots_ += static_cast<uint32_t>(bytes);
+          add(H_SALLOC, {dst(o[0]), SLOT | slot});
+        } else {
+          uint32_t bytes = count(n);
+          add(H_SALLOC_DYN, {dst(o[0]), bytes}, static_cast<uint8_t>(std::countr_zero(align)));
+        }
+        return;
+      }
+
+      case ADD:
+      case SUB:
+      case MUL:
+      case DIV:
+      case REM:
+      case AND:
+      case OR:
+      case XOR:
+      case MIN:
+      case MAX:
+      case SHL:
+      case SHR:
+      case ROL:
+      case ROR: return emit_binary(in);
+
+      case NEG:
+      case NOT:
+      case ABS:
+      case SQRT: return emit_unary(in);
+
+      case CMP: {
+        const opnd &a = op(in, 0), &b = op(in, 1);
+        uint8_t t = a.kind != okind::imm ? type(a) : b.kind != okind::imm ? type(b) : a.main;
+        kind k = kind_of(t);
+        if (k >= K_BF16) fail("CMP of type " + hex(t));
+        uint32_t s1 = src_as(a, t), s2 = src_as(b, t);
+        // Merged with the conditional branch that follows it
+        if (index + 1 < insns_.size() && insns_[index + 1].op == BR && has_param(insns_[index + 1], 1) &&
+            param(insns_[index + 1], 1) <= BRANCH_COND_NS) {
+          const insn &br = insns_[index + 1];
+          branch(add(h(H_CMPBR_i8, k), {s1, s2, 0}, param(br, 1)), 2, op(br, 0));
+        } else {
+          add(h(H_CMP_i8, k), {s1, s2});
+        }
+        return;
+      }
+
+      case SEL: {
+        uint8_t t = type(op(in, 0));
+        int s = size_index(size(o[0]));
+        if (s < 0 || s > 4) fail("SEL of size " + std::to_string(size(o[0])));
+        uint32_t a = src_as(op(in, 1), t), b = src_as(op(in, 2), t);
+        add(h(H_SEL_1, s), {dst(o[0]), a, b}, param(in, 3));
+        return;
+      }
+
+      case FMA: {
+        uint8_t t = type(op(in, 0));
+        kind k = kind_of(t);
+        if (!is_fp(k)) fail("FMA of type " + hex(t));
+        uint32_t a = src_as(op(in, 1), t), b = src_as(op(in, 2), t), c = src_as(op(in, 3), t);
+        add(h(H_FMA_f32, k - K_F32), {dst(o[0]), a, b, c});
+        return;
+      }
+
+      case POPCNT:
+      case CLZ:
+      case CTZ:
+      case FFS: {
+        const opnd &s = op(in, 1);
+        int n = size_index(size(s));
+        if (!is_int(kind_of(type(s))) || n < 0 || n > 4) fail("bit count of type " + hex(type(s)));
+        static constexpr handler base[] = {H_POPCNT_1, H_CLZ_1, H_CTZ_1, H_FFS_1};
+        uint32_t v = src(s);
+        add(h(base[in.op - POPCNT], n), {dst(op(in, 0)), v}, dest_size(o[0]));
+        return;
+      }
+
+      case BPOP:
+      case BFIND: {
+        uint32_t map = src(op(in, 1)), start = count(op(in, 2)), n = count(op(in, 3));
+        uint8_t mode = in.op == BFIND && has_param(in, 4) ? param(in, 4) : BFIND_SET;
+        add(in.op == BPOP ? H_BPOP : H_BFIND, {dst(o[0]), map, start, n}, dest_size(o[0]), mode);
+        return;
+      }
+
+      case BOP: {
+        uint32_t d = src(op(in, 0)), ds = count(op(in, 1)), a = src(op(in, 2)), b = src(op(in, 3));
+        uint32_t ss = count(op(in, 4)), n = count(op(in, 5));
+        add(H_BOP, {d, ds, a, b, ss, n}, param(in, 6));
+        return;
+      }
+
+      case ADDC:
+      case SUBB: {
+        uint8_t t = type(op(in, 0));
+        int s = size_index(size(o[0]));
+        if (!is_int(kind_of(t)) || s < 0 || s > 3) fail("ADDC and SUBB of type " + hex(t));
+        uint32_t a = src_as(op(in, 2), t), b = src_as(op(in, 3), t);
+        uint8_t zero = 0;
+        uint32_t in_carry = o.size() > 4 ? src(o[4]) : constant(&zero, 1);
+        add(h(in.op == ADDC ? H_ADDC_1 : H_SUBB_1, s), {dst(o[0]), dst(op(in, 1)), a, b, in_carry});
+        return;
+      }
+
+      case MULW: {
+        bool two = o.size() >= 4;
+        const opnd &a = op(in, two ? 2 : 1), &b = op(in, two ? 3 : 2);
+        uint8_t t = a.kind != okind::imm ? type(a) : b.kind != okind::imm ? type(b) : two ? type(o[0]) : a.main;
+        int k = int64_index(kind_of(t));
+        if (k < 0) fail("MULW of type " + hex(t));
+        uint32_t s1 = src_as(a, t), s2 = src_as(b, t);
+        if (two) {
+          uint32_t hi = dst(o[0]), lo = dst(o[1]);
+          add(h(H_MULW_i8, k), {hi, lo, s1, s2});
+        } else {
+          if (size(o[0]) != 2 * type_size(t)) fail("MULW dest is not twice the width of the sources");
+          uint32_t d = dst(o[0]);
+          add(h(H_MULW_i8, k), {d + type_size(t), d, s1, s2});
+        }
+        return;
+      }
+
+      case ADDSAT:
+      case SUBSAT: {
+        if (o.size() > 3) {
+          uint8_t l = lane(in, 3);
+          int k = int64_index(kind_of(l));
+          vector_info v = vec(op(in, 0));
+          lanes_of(v, l);
+          if (k < 0) fail("saturating lanes must be integers");
+          uint32_t a = src(op(in, 1)), b = src(op(in, 2));
+          add(h(in.op == ADDSAT ? H_VADDSAT_i8 : H_VSUBSAT_i8, k), {dst(o[0]), a, b}, 0, v.mode, v.bytes);
+          return;
+        }
+        uint8_t t = type(op(in, 0));
+        int k = int64_index(kind_of(t));
+        if (k < 0) fail("ADDSAT and SUBSAT of type " + hex(t));
+        uint32_t a = src_as(op(in, 1), t), b = src_as(op(in, 2), t);
+        add(h(in.op == ADDSAT ? H_ADDSAT_i8 : H_SUBSAT_i8, k), {dst(o[0]), a, b});
+        return;
+      }
+
+      case FMAW: {
+        static constexpr std::pair<kind, kind> forms[] = {{K_F32, K_BF16}, {K_F64, K_F32}, {K_I16, K_I8}, {K_I32, K_I16},
+                                                          {K_I64, K_I32},  {K_U16, K_U8},  {K_U32, K_U16}, {K_U64, K_U32}};
+        uint8_t w = type(op(in, 0));
+        const opnd &a = op(in, 1), &b = op(in, 2);
+        uint8_t n = a.kind != okind::imm ? type(a) : type(b);
+        auto it = std::find(std::begin(forms), std::end(forms), std::pair{kind_of(w), kind_of(n)});
+        if (it == std::end(forms)) fail("FMAW of these types is not supported");
+        uint32_t s1 = src_as(a, n), s2 = src_as(b, n), s3 = src_as(op(in, 3), w);
+        add(h(H_FMAW_f32_bf16, static_cast<int>(it - std::begin(forms))), {dst(o[0]), s1, s2, s3});
+        return;
+      }
+
+      case DOT: {
+        struct form {
+          kind acc, a, b;
+          bool operator==(const form &) const = default;
+        };
+        static constexpr form forms[] = {{K_F32, K_BF16, K_BF16}, {K_I32, K_I8, K_I8}, {K_I32, K_U8, K_U8},
+                                         {K_I32, K_U8, K_I8},     {K_I32, K_I8, K_U8}, {K_I32, K_I16, K_I16}};
+        vector_info v = vec(op(in, 0));
+        kind acc = kind_of(op(in, 4).main), a = kind_of(op(in, 5).main), b = o.size() > 6 ? kind_of(o[6].main) : a;
+        auto it = std::find(std::begin(forms), std::end(forms), form{acc, a, b});
+        if (it == std::end(forms)) fail("DOT of these lane types is not supported");
+        uint32_t s1 = src(op(in, 1)), s2 = src(op(in, 2)), s3 = src(op(in, 3));
+        add(h(H_DOT_f32_bf16_bf16, static_cast<int>(it - std::begin(forms))), {dst(o[0]), s1, s2, s3}, 0, v.mode, v.bytes);
+        return;
+      }
+
+      case CVT: {
+        uint8_t dt = type(op(in, 0)), st = type(op(in, 1));
+        kind d = kind_of(dt), s = kind_of(st);
+        if (d == K_NONE || s == K_NONE) fail("CVT from " + hex(st) + " to " + hex(dt) + " is not supported");
+        uint8_t round = has_param(in, 2) ? param(in, 2) : is_int(d) && !is_int(s) ? ROUND_ZERO : ROUND_NEAREST;
+        uint8_t sat = has_param(in, 3) ? param(in, 3) : SAT_NONE;
+        uint32_t from = src(o[1]);
+        add(h(H_CVT_i8_i8, 13 * d + s), {dst(o[0]), from}, round, sat);
+        return;
+      }
+
+      case VLOAD:
+      case VSTORE: {
+        bool load = in.op == VLOAD;
+        vector_info v = vec(op(in, load ? 0 : 1));
+        uint8_t l = lane(in, 2);
+        lanes_of(v, l);
+        uint32_t p = src(op(in, load ? 1 : 0));
+        if (load) add(H_VLOAD, {dst(o[0]), p}, static_cast<uint8_t>(type_size(l)), v.mode, v.bytes);
+        else add(H_VSTORE, {p, src(o[1])}, static_cast<uint8_t>(type_size(l)), v.mode, v.bytes);
+        return;
+      }
+
+      case VLOADM:
+      case VSTOREM: {
+        bool load = in.op == VLOADM;
+        vector_info v = vec(op(in, load ? 0 : 1));
+        uint8_t l = lane(in, 3);
+        lanes_of(v, l);
+        int s = size_index(type_size(l));
+        uint32_t p = src(op(in, load ? 1 : 0)), m = src(op(in, 2));
+        if (load) add(h(H_VLOADM_1, s), {dst(o[0]), p, m}, 0, v.mode, v.bytes);
+        else add(h(H_VSTOREM_1, s), {p, src(o[1]), m}, 0, v.mode, v.bytes);
+        return;
+      }
+
+      case VGATHER:
+      case VSCATTER: {
+        bool gather = in.op == VGATHER;
+        vector_info v = vec(op(in, gather ? 0 : 2));
+        uint8_t l = lane(in, 3), il = lane(in, 4);
+        if (!is_signed(kind_of(il))) fail("index lanes must be signed integers");
+        uint32_t lanes = lanes_of(v, l);
+        int s = size_index(type_size(l)), is = size_index(type_size(il));
+        uint8_t mode = v.mode | (o.size() > 5 ? MODE_MASK : 0);
+        uint32_t mask = o.size() > 5 ? src(o[5]) : 0;
+        uint32_t base = src(op(in, 0)), index_vec = src(op(in, 1));
+        if (gather)
+          add(h(H_VGATHER_i8_1, 4 * is + s), {dst(o[0]), src(op(in, 1)), src(op(in, 2)), mask}, 0, mode, lanes);
+        else
+          add(h(H_VSCATTER_i8_1, 4 * is + s), {base, index_vec, src(op(in, 2)), mask}, 0, mode, lanes);
+        return;
+      }
+
+      case VSPLAT: {
+        vector_info v = vec(op(in, 0));
+        uint8_t l = lane(in, 2);
+        lanes_of(v, l);
+        uint32_t s = src_as(op(in, 1), l);
+        add(h(H_VSPLAT_1, size_index(type_size(l))), {dst(o[0]), s}, 0, v.mode, v.bytes);
+        return;
+      }
+
+      case VEXTRACT: {
+        vector_info v = vec(op(in, 1));
+        uint8_t l = lane(in, 3);
+        lanes_of(v, l);
+        uint32_t s = src(o[1]), n = count(op(in, 2));
+        add(h(H_VEXTRACT_1, size_index(type_size(l))), {dst(o[0]), s, n}, 0, v.mode, v.bytes);
+        return;
+      }
+
+      case VINSERT: {
+        vector_info v = vec(op(in, 0));
+        uint8_t l = lane(in, 4);
+        lanes_of(v, l);
+        uint32_t s = src(op(in, 1)), x = src_as(op(in, 2), l), n = count(op(in, 3));
+        add(h(H_VINSERT_1, size_index(type_size(l))), {dst(o[0]), s, x, n}, 0, v.mode, v.bytes);
+        return;
+      }
+
+      case VSHUFFLE:
+      case VPERMUTE: {
+        bool shuffle = in.op == VSHUFFLE;
+        vector_info v = vec(op(in, 0));
+        uint8_t l = lane(in, shuffle ? 4 : 3);
+        lanes_of(v, l);
+        int s = size_index(type_size(l));
+        uint32_t a = src(op(in, 1)), b = src(op(in, 2));
+        if (shuffle) add(h(H_VSHUFFLE_1, s), {dst(o[0]), a, b, src(op(in, 3))}, 0, v.mode, v.bytes);
+        else add(h(H_VPERMUTE_1, s), {dst(o[0]), a, b}, 0, v.mode, v.bytes);
+        return;
+      }
+
+      case VADD:
+      case VSUB:
+      case VMUL:
+      case VDIV:
+      case VMIN:
+      case VMAX:
+      case VAND:
+      case VOR:
+      case VXOR: {
+        vector_info v = vec(op(in, 0));
+        uint8_t l = lane(in, 3);
+        lanes_of(v, l);
+        uint32_t a = src(op(in, 1)), b = src(op(in, 2));
+        static constexpr handler base[] = {H_VADD_i8, H_VSUB_i8, H_VMUL_i8, H_VDIV_i8, H_VMIN_i8, H_VMAX_i8, H_VAND, H_VOR, H_VXOR};
+        int i = in.op - VADD;
+        add(in.op >= VAND ? h(base[i], 0) : h(base[i], lane_index(kind_of(l))), {dst(o[0]), a, b}, 0, v.mode, v.bytes);
+        return;
+      }
+
+      case VSHL:
+      case VSHR: {
+        vector_info v = vec(op(in, 0));
+        uint8_t l = lane(in, 3);
+        lanes_of(v, l);
+        int k = int64_index(kind_of(l));
+        if (k < 0) fail("shifted lanes must be integers");
+        const opnd &c = op(in, 2);
+        bool per_lane = category(type(c)) == TYPE_CAT_VEC;
+        uint32_t a = src(o[1]), n = per_lane ? src(c) : count(c);
+        add(h(in.op == VSHL ? H_VSHL_i8 : H_VSHR_i8, k), {dst(o[0]), a, n}, 0, v.mode | (per_lane ? MODE_VCOUNT : 0), v.bytes);
+        return;
+      }
+
+      case VFMA: {
+        vector_info v = vec(op(in, 0));
+        uint8_t l = lane(in, 4);
+        lanes_of(v, l);
+        if (!is_fp(kind_of(l))) fail("VFMA lanes must be floating point");
+        uint32_t a = src(op(in, 1)), b = src(op(in, 2)), c = src(op(in, 3));
+        add(h(H_VFMA_f32, kind_of(l) - K_F32), {dst(o[0]), a, b, c}, 0, v.mode, v.bytes);
+        return;
+      }
+
+      case VCMP: {
+        vector_info v = vec(op(in, 0));
+        uint8_t l = lane(in, 4), cond = param(in, 3);
+        lanes_of(v, l);
+        if (cond > BRANCH_COND_LE) fail("VCMP takes an ordered condition");
+        uint32_t a = src(op(in, 1)), b = src(op(in, 2));
+        add(h(H_VCMP_i8, lane_index(kind_of(l))), {dst(o[0]), a, b}, cond, v.mode, v.bytes);
+        return;
+      }
+
+      case VSELECT: {
+        vector_info v = vec(op(in, 0));
+        lanes_of(v, lane(in, 4));
+        uint32_t m = src(op(in, 1)), a = src(op(in, 2)), b = src(op(in, 3));
+        add(H_VSELECT, {dst(o[0]), m, a, b}, 0, v.mode, v.bytes);
+        return;
+      }
+
+      case VREDUCE: {
+        vector_info v = vec(op(in, 1));
+        uint8_t l = lane(in, 3), r = param(in, 2);
+        lanes_of(v, l);
+        if (r > REDUCE_ADD_ORD) fail("bad REDUCE");
+        uint32_t s = src(o[1]), m = o.size() > 4 ? src(o[4]) : 0;
+        uint8_t mode = v.mode | (o.size() > 4 ? MODE_MASK : 0);
+        add(h(H_VREDUCE_i8, lane_index(kind_of(l))), {dst(op(in, 0)), s, m}, r, mode, v.bytes);
+        return;
+      }
+
+      case VCVT: {
+        vector_info dv = vec(op(in, 0)), sv = vec(op(in, 1));
+        uint8_t dl = lane(in, 2), sl = lane(in, 3);
+        uint32_t lanes = std::min(lanes_of(sv, sl), lanes_of(dv, dl));
+        if (!dv.mode && lanes != lanes_of(sv, sl)) fail("VCVT dest does not hold every lane of src");
+        kind d = kind_of(dl), s = kind_of(sl);
+        uint8_t round = is_int(d) && !is_int(s) ? ROUND_ZERO : ROUND_NEAREST;
+        uint32_t from = src(o[1]);
+        add(h(H_VCVT_i8_i8, 10 * lane_index(d) + lane_index(s)), {dst(o[0]), from}, round, dv.mode, lanes);
+        return;
+      }
+
+      case VSETVL: {
+        uint8_t l = lane(in, 2);
+        uint32_t n = count(op(in, 1));
+        add(H_VSETVL, {dst(op(in, 0)), n}, dest_size(o[0]), 0, 64 / type_size(l));
+        return;
+      }
+
+      case VLANES:
+      case HASFEAT: {
+        // Constants of the target, VLANES of a 64 byte TYPE_VS and no
+        // features at all
+        uint64_t value = in.op == VLANES ? 64 / type_size(lane(in, 1)) : 0;
+        int s = size_index(size(op(in, 0)));
+        if (s < 0 || s > 3) fail("dest must be an integer");
+        add(h(H_MOV_1, s), {dst(o[0]), constant_u64(value)});
+        return;
+      }
+
+      case TLOAD:
+      case TSTORE: {
+        bool load = in.op == TLOAD;
+        const var_info &t = tile(op(in, load ? 0 : 1));
+        uint32_t p = src(op(in, load ? 1 : 0)), stride = count(op(in, 2));
+        if (load) add(H_TLOAD, {t.offset, p, stride, t.row_bytes}, 0, 0, t.rows);
+        else add(H_TSTORE, {p, t.offset, stride, t.row_bytes}, 0, 0, t.rows);
+        return;
+      }
+
+      case TZERO: {
+        const var_info &t = tile(op(in, 0));
+        add(H_TZERO, {t.offset}, 0, 0, t.size);
+        return;
+      }
+
+      case TMMA: {
+        struct form {
+          kind acc, a, b;
+          bool operator==(const form &) const = default;
+        };
+        static constexpr form forms[] = {{K_F32, K_F32, K_F32}, {K_F32, K_BF16, K_BF16}, {K_I32, K_I8, K_I8},
+                                         {K_I32, K_U8, K_U8},   {K_I32, K_U8, K_I8},     {K_I32, K_I8, K_U8}};
+        const var_info &c = tile(op(in, 0)), &a = tile(op(in, 1)), &b = tile(op(in, 2));
+        auto it = std::find(std::begin(forms), std::end(forms), form{kind_of(c.lane), kind_of(a.lane), kind_of(b.lane)});
+        if (it == std::end(forms)) fail("TMMA of these lane types is not supported");
+        uint32_t m = c.rows, k = a.row_bytes / type_size(a.lane), n = c.row_bytes / type_size(c.lane);
+        if (a.rows != m || b.rows != k || b.row_bytes / type_size(b.lane) != n) fail("TMMA shapes do not agree");
+        add(h(H_TMMA_f32_f32_f32, static_cast<int>(it - std::begin(forms))), {c.offset, a.offset, b.offset, m, k, n});
+        return;
+      }
+
+      case MCOPYA:
+      case LAUNCH:
+      case WAIT:
+      case KID:
+      case BARRIER: fail("offload instructions are not supported");
+
+      default: fail("unknown opcode " + hex(in.op));
+    }
+  }
+
+  uint8_t dest_size(const opnd &o) const {
+    uint32_t n = size(o);
+    if (!is_int(kind_of(type(o))) || n > 16) fail("dest must be an integer");
+    return static_cast<uint8_t>(n);
+  }
+
+  const var_info &tile(const opnd &o) const {
+    if (o.kind != okind::var || var(o).main != TYPE_TILE) fail("operand must be a tile variable");
+    return var(o);
+  }
+
+  void emit_binary(const insn &in) {
+    uint8_t t = type(op(in, 0));
+    kind k = kind_of(t);
+    bool integer_only = in.op == REM || in.op == AND || in.op == OR || in.op == XOR || (in.op >= SHL && in.op <= ROR);
+    if (k >= K_BF16 || (integer_only && !is_int(k))) fail("instruction " + hex(in.op) + " of type " + hex(t));
+    uint32_t a = src_as(op(in, 1), t), b = src_as(op(in, 2), t);
+    uint16_t handler;
+    switch (in.op) {
+      case ADD: handler = h(reads_zsco_ && is_int(k) ? H_ADDF_i8 : H_ADD_i8, k); break;
+      case SUB: handler = h(reads_zsco_ && is_int(k) ? H_SUBF_i8 : H_SUB_i8, k); break;
+      case MUL: handler = h(H_MUL_i8, k); break;
+      case DIV: handler = h(H_DIV_i8, k); break;
+      case REM: handler = h(H_REM_i8, k); break;
+      case AND: handler = h(H_AND_i8, k); break;
+      case OR: handler = h(H_OR_i8, k); break;
+      case XOR: handler = h(H_XOR_i8, k); break;
+      case MIN: handler = h(H_MIN_i8, k); break;
+      case MAX: handler = h(H_MAX_i8, k); break;
+      case SHL: handler = h(H_SHL_i8, k); break;
+      case SHR: handler = h(H_SHR_i8, k); break;
+      case ROL: handler = h(H_ROL_i8, k); break;
+      default: handler = h(H_ROR_i8, k); break;
+    }
+    add(handler, {dst(in.ops[0]), a, b});
+  }
+
+  void emit_unary(const insn &in) {
+    uint8_t t = type(op(in, 0));
+    kind k = kind_of(t);
+    if (k >= K_BF16 || (in.op == NOT && !is_int(k)) || (in.op == SQRT && !is_fp(k))) fail("instruction " + hex(in.op) + " of type " + hex(t));
+    uint32_t a = src_as(op(in, 1), t);
+    switch (in.op) {
+      case NEG: add(h(reads_zsco_ && is_int(k) ? H_NEGF_i8 : H_NEG_i8, k), {dst(in.ops[0]), a}); break;
+      case NOT:
+        if (t == TYPE_BIT) {
+          uint8_t one = 1;
+          add(H_XOR_u8, {dst(in.ops[0]), a, constant(&one, 1)});
+        } else {
+          add(h(H_NOT_i8, k), {dst(in.ops[0]), a});
+        }
+        break;
+      case ABS: add(h(H_ABS_i8, k), {dst(in.ops[0]), a}); break;
+      default: add(h(H_SQRT_f32, k - K_F32), {dst(in.ops[0]), a}); break;
+    }
+  }
+
+  void emit_call(const insn &in) {
+    call_site site{};
+    const opnd &target = op(in, 0);
+    if (target.kind == okind::sym && target.main == TYPE_SYM) site.target = callee(target.index);
+    else site.slot = src(target);
+
+    std::vector<uint32_t> args, rets;
+    bool tail = false;
+    for (size_t i = 1; i < in.ops.size();) {
+      uint8_t p = param(in, i++);
+      std::vector<uint32_t> *list = p == BRANCH_CTRL_ABI_PARAM ? &args : p == BRANCH_CTRL_ABI_RET ? &rets : nullptr;
+      if (p == BRANCH_CTRL_ABI) i++;
+      if (p == BRANCH_CTRL_TAIL) tail = true;
+      for (; i < in.ops.size() && in.ops[i].kind != okind::param; i++) {
+        if (!list) fail("operand after a BRANCH_CTRL that takes none");
+        list->push_back(list == &args ? src(in.ops[i]) : dst(in.ops[i]));
+      }
+    }
+    if (tail && !rets.empty()) fail("tail call with BRANCH_CTRL_ABI_RET");
+    site.args = static_cast<uint32_t>(out_->extra.size());
+    site.nargs = static_cast<uint32_t>(args.size());
+    out_->extra.insert(out_->extra.end(), args.begin(), args.end());
+    site.rets = static_cast<uint32_t>(out_->extra.size());
+    site.nrets = static_cast<uint32_t>(rets.size());
+    out_->extra.insert(out_->extra.end(), rets.begin(), rets.end());
+    out_->calls.push_back(site);
+    add(tail ? H_TAIL : H_CALL, {static_cast<uint32_t>(out_->calls.size() - 1)});
+  }
+
+  // Lays out the temporaries and slots and resolves branch targets
+  void finish() {
+    at_ = insns_.size();
+    decoded &d = *out_;
+    uint32_t temp_base = (consts_ + 63) & ~63u;
+    uint32_t slot_base = (temp_base + temps_ + 63) & ~63u;
+    if (uint64_t{slot_base} + slots_ > OFFSET) fail("frame too large");
+    d.frame_size = (slot_base + slots_ + 63) & ~63u;
+    d.init.resize(consts_ - d.init_begin);
+
+    for (const fixup &f : fixups_) {
+      uint32_t &v = f.where == fixup::RECORD ? d.code[f.index].a[f.field] : f.where == fixup::EXTRA ? d.extra[f.index] : d.cases[f.index].second;
+      v = first_[v];
+    }
+    auto place = [&](uint32_t &v) {
+      if (v & TEMP) v = temp_base + (v & OFFSET);
+      else if (v & SLOT) v = slot_base + (v & OFFSET);
+    };
+    for (record &r : d.code)
+      for (uint32_t &a : r.a) place(a);
+    for (uint32_t &e : d.extra) place(e);
+    for (call_site &c : d.calls) place(c.slot);
+
+    const void *const *labels = handler_labels();
+    if (labels)
+      for (record &r : d.code) r.handler = labels[r.op];
+  }
+
+  engine::image &img_;
+  const object &obj_;
+  function &fn_;
+  std::unique_ptr<decoded> out_;
+
+  std::vector<insn> insns_;
+  std::vector<uint64_t> offsets_;
+  std::vector<bool> in_loop_;
+  std::unordered_map<uint32_t, var_info> vars_;
+  bool reads_zsco_ = false;
+  size_t at_ = 0;
+
+  std::map<std::string, uint32_t> constants_;
+  uint32_t consts_ = 0;
+  uint32_t temp_ = 0, temps_ = 0, slots_ = 0;
+  std::vector<std::tuple<uint32_t, uint32_t, uint32_t>> stores_;  // temporary, address constant, size
+  std::vector<uint32_t> first_;
+  std::vector<fixup> fixups_;
+};
+
+}  // namespace
+
+std::unique_ptr<decoded> decode(engine::image &img, function &fn) { return decoder(img, fn).run(); }
+
+}  // namespace coil::detail
@@ -0,0 +1,172 @@
+// Loading objects and calling functions (include/coil/engine.hpp)
+
+#include "engine_impl.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace coil {
+
+namespace {
+
+bool is_data(const section_header &s) { return s.type == SECT_DATA || s.type == SECT_RODATA || s.type == SECT_BSS; }
+
+bool defines(const object &obj, uint32_t index) {
+  const symbol_entry &s = obj.symbol(index);
+  return s.section != 0 && (s.bind == SYM_BIND_GLOBAL || s.bind == SYM_BIND_WEAK);
+}
+
+}  // namespace
+
+engine::engine() = default;
+engine::~engine() = default;
+
+void engine::load(object obj) {
+  auto img = std::make_unique<image>(std::move(obj));
+  img->engine = this;
+  const object &o = img->object;
+  uint32_t sections = o.section_count();
+  img->base.assign(sections, nullptr);
+
+  for (uint32_t i = 1; i < sections; i++) {
+    const section_header &s = o.section(i);
+    if (!is_data(s)) continue;
+    if (s.flags & SECT_FLAG_TLS) throw error("engine: thread local sections are not supported");
+    size_t align = std::max<size_t>(size_t{1} << std::min<uint8_t>(s.align, 12), 16);
+    auto &mem = img->memory.emplace_back(new uint8_t[s.size + align]());
+    uint8_t *p = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(mem.get()) + align - 1) & ~uintptr_t(align - 1));
+    if (s.type != SECT_BSS) {
+      std::span<const uint8_t> bytes = o.contents(i);
+      std::memcpy(p, bytes.data(), bytes.size());
+    }
+    img->base[i] = p;
+  }
+
+  img->by_symbol.assign(o.symbol_count(), nullptr);
+  for (uint32_t i = 1; i < o.symbol_count(); i++) {
+    const symbol_entry &s = o.symbol(i);
+    if (s.kind != SYM_KIND_FUNC || s.section == 0) continue;
+    if (s.section >= sections || o.section(s.section).type != SECT_CODE)
+      throw error("engine: function " + std::string(o.symbol_name(i)) + " is not in a code section");
+    auto fn = std::make_unique<function>();
+    fn->image = img.get();
+    fn->symbol = i;
+    fn->section = s.section;
+    fn->offset = s.value;
+    fn->size = s.size;
+    fn->name = o.symbol_name(i);
+    img->by_symbol[i] = fn.get();
+    img->functions.push_back(std::move(fn));
+  }
+
+  image &loaded = *img;
+  images_.push_back(std::move(img));
+  try {
+    for (uint32_t i = 1; i < sections; i++) {
+      const section_header &r = o.section(i);
+      if (r.type != SECT_RELOC) continue;
+      if (r.link >= sections || !loaded.base[r.link]) throw error("engine: relocation of a section that is not data");
+      const section_header &target = o.section(r.link);
+      std::span<const uint8_t> entries = o.contents(i);
+      for (size_t at = 0; at + sizeof(reloc_entry) <= entries.size(); at += sizeof(reloc_entry)) {
+        reloc_entry e;
+        std::memcpy(&e, entries.data() + at, sizeof e);
+        size_t width = e.type == RELOC_ADDR32 || e.type == RELOC_REL32 ? 4 : 8;
+        if (e.type < RELOC_ADDR || e.type > RELOC_REL32) throw error("engine: unknown relocation type");
+        if (e.offset > target.size || width > target.size - e.offset) throw error("engine: relocation outside its section");
+        uint8_t *p = loaded.base[r.link] + e.offset;
+        uint64_t s = loaded.address(e.symbol) + static_cast<uint64_t>(e.addend);
+        if (e.type == RELOC_ADDR || e.type == RELOC_ADDR64) {
+          std::memcpy(p, &s, 8);
+        } else if (e.type == RELOC_ADDR32) {
+          if (s > UINT32_MAX) throw error("engine: RELOC_ADDR32 address does not fit 32 bits");
+          uint32_t v = static_cast<uint32_t>(s);
+          std::memcpy(p, &v, 4);
+        } else {
+          int64_t d = static_cast<int64_t>(s - reinterpret_cast<uint64_t>(p));
+          if (d < INT32_MIN || d > INT32_MAX) throw error("engine: RELOC_REL32 distance does not fit 32 bits");
+          int32_t v = static_cast<int32_t>(d);
+          std::memcpy(p, &v, 4);
+        }
+      }
+    }
+  } catch (...) {
+    images_.pop_back();
+    throw;
+  }
+}
+
+function *engine::find(std::string_view name) const {
+  function *weak = nullptr;
+  for (const auto &img : images_) {
+    uint32_t i = img->object.find(name);
+    if (!i || !defines(img->object, i) || !img->by_symbol[i]) continue;
+    if (img->object.symbol(i).bind == SYM_BIND_GLOBAL) return img->by_symbol[i];
+    if (!weak) weak = img->by_symbol[i];
+  }
+  return weak;
+}
+
+void *engine::data(std::string_view name) const {
+  void *weak = nullptr;
+  for (const auto &img : images_) {
+    uint32_t i = img->object.find(name);
+    if (!i || !defines(img->object, i)) continue;
+    const symbol_entry &s = img->object.symbol(i);
+    if (s.section >= img->base.size() || !img->base[s.section]) continue;
+    void *p = img->base[s.section] + s.value;
+    if (s.bind == SYM_BIND_GLOBAL) return p;
+    if (!weak) weak = p;
+  }
+  return weak;
+}
+
+uint64_t engine::image::address(uint32_t symbol) const {
+  const symbol_entry &s = object.symbol(symbol);
+  if (s.section == 0) {
+    std::string_view name = object.symbol_name(symbol);
+    if (function *fn = engine->find(name)) return reinterpret_cast<uint64_t>(fn);
+    if (void *p = engine->data(name)) return reinterpret_cast<uint64_t>(p);
+    throw error("engine: undefined symbol " + std::string(name));
+  }
+  if (by_symbol[symbol]) return reinterpret_cast<uint64_t>(by_symbol[symbol]);
+  if (s.section >= base.size() || !base[s.section]) throw error("engine: symbol " + std::string(object.symbol_name(symbol)) + " has no address");
+  return reinterpret_cast<uint64_t>(base[s.section] + s.value);
+}
+
+function *engine::image::callee(uint32_t symbol) const {
+  if (symbol >= by_symbol.size()) throw error("engine: symbol index out of range");
+  if (by_symbol[symbol]) return by_symbol[symbol];
+  if (object.symbol(symbol).section == 0) return engine->find(object.symbol_name(symbol));
+  return nullptr;
+}
+
+void engine::prepare(function &fn) { fn.code(); }
+
+void engine::call(function &fn, std::span<const uint64_t> args, std::span<uint64_t> results) {
+  const detail::decoded &d = fn.code();
+  detail::thread_stack &stack = detail::this_thread_stack();
+  stack.alloc(0);
+  uint8_t *top = stack.top;
+  try {
+    uint8_t *f = stack.alloc(d.frame_size);
+    detail::init_frame(d, f);
+    size_t n = std::min(args.size(), d.params.size());
+    for (size_t i = 0; i < n; i++) {
+      std::memset(f + d.params[i].first, 0, d.params[i].second);
+      std::memcpy(f + d.params[i].first, &args[i], std::min<size_t>(d.params[i].second, 8));
+    }
+    // Results of up to 64 bytes each, the low 8 are returned
+    std::vector<uint8_t> out(64 * results.size());
+    std::vector<uint32_t> offsets(results.size());
+    for (size_t i = 0; i < results.size(); i++) offsets[i] = static_cast<uint32_t>(64 * i);
+    detail::execute(d, f, out.data(), offsets.data(), static_cast<uint32_t>(results.size()));
+    for (size_t i = 0; i < results.size(); i++) std::memcpy(&results[i], out.data() + 64 * i, 8);
+  } catch (...) {
+    stack.top = top;
+    throw;
+  }
+  stack.top = top;
+}
+
+}  // namespace coil
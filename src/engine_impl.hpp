@@ -0,0 +1,290 @@
+// Internal structures of the engine, shared by the decoder and the dispatch
+// loop. See include/coil/engine.hpp and v1/impl.md.
+
+#ifndef COIL_ENGINE_IMPL_HPP
+#define COIL_ENGINE_IMPL_HPP
+
+#include <coil/engine.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef __SIZEOF_INT128__
+#error "the engine needs a compiler with 128-bit integers"
+#endif
+
+#if !defined(COIL_SWITCH_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+#define COIL_THREADED 1
+#else
+#define COIL_THREADED 0
+#endif
+
+namespace coil::detail {
+
+using i8 = int8_t;
+using i16 = int16_t;
+using i32 = int32_t;
+using i64 = int64_t;
+using u8 = uint8_t;
+using u16 = uint16_t;
+using u32 = uint32_t;
+using u64 = uint64_t;
+__extension__ typedef __int128 i128;
+__extension__ typedef unsigned __int128 u128;
+using f32 = float;
+using f64 = double;
+
+// TYPE_FP16b, the upper half of a TYPE_FP32
+struct bf16 {
+  uint16_t bits;
+};
+
+// The scalar types handlers are specialized on, in the order of the handler
+// families below
+enum kind : uint8_t { K_I8, K_I16, K_I32, K_I64, K_I128, K_U8, K_U16, K_U32, K_U64, K_U128, K_F32, K_F64, K_BF16, K_NONE };
+
+// Handler families, F(name, handler) for every type of the family. The
+// decoder picks a handler as the first of its family plus the index of the
+// operand type in the family.
+#define COIL_EACH_INT(F, name, fn)                                                                     \
+  F(name##_i8, fn<i8>) F(name##_i16, fn<i16>) F(name##_i32, fn<i32>) F(name##_i64, fn<i64>)            \
+  F(name##_i128, fn<i128>) F(name##_u8, fn<u8>) F(name##_u16, fn<u16>) F(name##_u32, fn<u32>)          \
+  F(name##_u64, fn<u64>) F(name##_u128, fn<u128>)
+#define COIL_EACH_FP(F, name, fn) F(name##_f32, fn<f32>) F(name##_f64, fn<f64>)
+#define COIL_EACH_NUM(F, name, fn) COIL_EACH_INT(F, name, fn) COIL_EACH_FP(F, name, fn)
+// Integers up to 64 bits, the atomic and lane integer types
+#define COIL_EACH_INT64(F, name, fn)                                                                   \
+  F(name##_i8, fn<i8>) F(name##_i16, fn<i16>) F(name##_i32, fn<i32>) F(name##_i64, fn<i64>)            \
+  F(name##_u8, fn<u8>) F(name##_u16, fn<u16>) F(name##_u32, fn<u32>) F(name##_u64, fn<u64>)
+#define COIL_EACH_LANE(F, name, fn) COIL_EACH_INT64(F, name, fn) COIL_EACH_FP(F, name, fn)
+// Sizes in bytes, of scalars, of every value and of atomics and lanes
+#define COIL_EACH_SIZE(F, name, fn) F(name##_1, fn<1>) F(name##_2, fn<2>) F(name##_4, fn<4>) F(name##_8, fn<8>) F(name##_16, fn<16>)
+#define COIL_EACH_WIDTH(F, name, fn) COIL_EACH_SIZE(F, name, fn) F(name##_32, fn<32>) F(name##_64, fn<64>)
+#define COIL_EACH_SIZE8(F, name, fn) F(name##_1, fn<1>) F(name##_2, fn<2>) F(name##_4, fn<4>) F(name##_8, fn<8>)
+
+#define COIL_CVT_FROM(F, d)                                                                            \
+  F(CVT_##d##_i8, (h_cvt<d, i8>)) F(CVT_##d##_i16, (h_cvt<d, i16>)) F(CVT_##d##_i32, (h_cvt<d, i32>))  \
+  F(CVT_##d##_i64, (h_cvt<d, i64>)) F(CVT_##d##_i128, (h_cvt<d, i128>)) F(CVT_##d##_u8, (h_cvt<d, u8>)) \
+  F(CVT_##d##_u16, (h_cvt<d, u16>)) F(CVT_##d##_u32, (h_cvt<d, u32>)) F(CVT_##d##_u64, (h_cvt<d, u64>)) \
+  F(CVT_##d##_u128, (h_cvt<d, u128>)) F(CVT_##d##_f32, (h_cvt<d, f32>)) F(CVT_##d##_f64, (h_cvt<d, f64>)) \
+  F(CVT_##d##_bf16, (h_cvt<d, bf16>))
+// CVT from every kind to every kind, H_CVT_i8_i8 + 13 * dest + src
+#define COIL_CVT(F)                                                                                    \
+  COIL_CVT_FROM(F, i8) COIL_CVT_FROM(F, i16) COIL_CVT_FROM(F, i32) COIL_CVT_FROM(F, i64)               \
+  COIL_CVT_FROM(F, i128) COIL_CVT_FROM(F, u8) COIL_CVT_FROM(F, u16) COIL_CVT_FROM(F, u32)              \
+  COIL_CVT_FROM(F, u64) COIL_CVT_FROM(F, u128) COIL_CVT_FROM(F, f32) COIL_CVT_FROM(F, f64)             \
+  COIL_CVT_FROM(F, bf16)
+
+#define COIL_VCVT_FROM(F, d)                                                                           \
+  F(VCVT_##d##_i8, (h_vcvt<d, i8>)) F(VCVT_##d##_i16, (h_vcvt<d, i16>)) F(VCVT_##d##_i32, (h_vcvt<d, i32>)) \
+  F(VCVT_##d##_i64, (h_vcvt<d, i64>)) F(VCVT_##d##_u8, (h_vcvt<d, u8>)) F(VCVT_##d##_u16, (h_vcvt<d, u16>)) \
+  F(VCVT_##d##_u32, (h_vcvt<d, u32>)) F(VCVT_##d##_u64, (h_vcvt<d, u64>)) F(VCVT_##d##_f32, (h_vcvt<d, f32>)) \
+  F(VCVT_##d##_f64, (h_vcvt<d, f64>))
+// VCVT between lane types, H_VCVT_i8_i8 + 10 * dest + src
+#define COIL_VCVT(F)                                                                                   \
+  COIL_VCVT_FROM(F, i8) COIL_VCVT_FROM(F, i16) COIL_VCVT_FROM(F, i32) COIL_VCVT_FROM(F, i64)           \
+  COIL_VCVT_FROM(F, u8) COIL_VCVT_FROM(F, u16) COIL_VCVT_FROM(F, u32) COIL_VCVT_FROM(F, u64)           \
+  COIL_VCVT_FROM(F, f32) COIL_VCVT_FROM(F, f64)
+
+// The mixed precision forms, wide type then narrow types
+#define COIL_FMAW(F)                                                                                   \
+  F(FMAW_f32_bf16, (h_fmaw<f32, bf16>)) F(FMAW_f64_f32, (h_fmaw<f64, f32>))                            \
+  F(FMAW_i16_i8, (h_fmaw<i16, i8>)) F(FMAW_i32_i16, (h_fmaw<i32, i16>)) F(FMAW_i64_i32, (h_fmaw<i64, i32>)) \
+  F(FMAW_u16_u8, (h_fmaw<u16, u8>)) F(FMAW_u32_u16, (h_fmaw<u32, u16>)) F(FMAW_u64_u32, (h_fmaw<u64, u32>))
+#define COIL_DOT(F)                                                                                    \
+  F(DOT_f32_bf16_bf16, (h_dot<f32, bf16, bf16>)) F(DOT_i32_i8_i8, (h_dot<i32, i8, i8>))                \
+  F(DOT_i32_u8_u8, (h_dot<i32, u8, u8>)) F(DOT_i32_u8_i8, (h_dot<i32, u8, i8>))                        \
+  F(DOT_i32_i8_u8, (h_dot<i32, i8, u8>)) F(DOT_i32_i16_i16, (h_dot<i32, i16, i16>))
+#define COIL_TMMA(F)                                                                                   \
+  F(TMMA_f32_f32_f32, (h_tmma<f32, f32, f32>)) F(TMMA_f32_bf16_bf16, (h_tmma<f32, bf16, bf16>))        \
+  F(TMMA_i32_i8_i8, (h_tmma<i32, i8, i8>)) F(TMMA_i32_u8_u8, (h_tmma<i32, u8, u8>))                    \
+  F(TMMA_i32_u8_i8, (h_tmma<i32, u8, i8>)) F(TMMA_i32_i8_u8, (h_tmma<i32, i8, u8>))
+
+// Handlers that continue with the next record
+#define COIL_STRAIGHT(F)                                                                               \
+  COIL_EACH_WIDTH(F, MOV, h_mov)                                                                       \
+  COIL_EACH_NUM(F, ADD, h_add) COIL_EACH_INT(F, ADDF, h_add_flags)                                     \
+  COIL_EACH_NUM(F, SUB, h_sub) COIL_EACH_INT(F, SUBF, h_sub_flags)                                     \
+  COIL_EACH_NUM(F, MUL, h_mul) COIL_EACH_NUM(F, DIV, h_div) COIL_EACH_INT(F, REM, h_rem)               \
+  COIL_EACH_NUM(F, NEG, h_neg) COIL_EACH_INT(F, NEGF, h_neg_flags)                                     \
+  COIL_EACH_INT(F, AND, h_and) COIL_EACH_INT(F, OR, h_or) COIL_EACH_INT(F, XOR, h_xor)                 \
+  COIL_EACH_INT(F, NOT, h_not) COIL_EACH_INT(F, SHL, h_shl) COIL_EACH_INT(F, SHR, h_shr)               \
+  COIL_EACH_INT(F, ROL, h_rol) COIL_EACH_INT(F, ROR, h_ror)                                           \
+  COIL_EACH_NUM(F, CMP, h_cmp) COIL_EACH_SIZE(F, SEL, h_sel)                                           \
+  COIL_EACH_NUM(F, MIN, h_min) COIL_EACH_NUM(F, MAX, h_max) COIL_EACH_NUM(F, ABS, h_abs)               \
+  COIL_EACH_FP(F, FMA, h_fma) COIL_EACH_FP(F, SQRT, h_sqrt)                                            \
+  COIL_EACH_SIZE(F, POPCNT, h_popcnt) COIL_EACH_SIZE(F, CLZ, h_clz)                                    \
+  COIL_EACH_SIZE(F, CTZ, h_ctz) COIL_EACH_SIZE(F, FFS, h_ffs)                                          \
+  F(BPOP, h_bpop) F(BFIND, h_bfind) F(BOP, h_bop)                                                      \
+  COIL_EACH_SIZE8(F, ADDC, h_addc) COIL_EACH_SIZE8(F, SUBB, h_subb)                                    \
+  COIL_EACH_INT64(F, MULW, h_mulw) COIL_EACH_INT64(F, ADDSAT, h_addsat) COIL_EACH_INT64(F, SUBSAT, h_subsat) \
+  COIL_FMAW(F) COIL_CVT(F)                                                                             \
+  COIL_EACH_WIDTH(F, LOAD, h_load) COIL_EACH_WIDTH(F, STORE, h_store)                                  \
+  COIL_EACH_SIZE8(F, LOADA, h_load_atomic) COIL_EACH_SIZE8(F, STOREA, h_store_atomic)                  \
+  COIL_EACH_SIZE8(F, XCHG, h_xchg) COIL_EACH_SIZE8(F, CAS, h_cas)                                      \
+  COIL_EACH_INT64(F, FETCH_ADD, h_fetch_add) COIL_EACH_INT64(F, FETCH_SUB, h_fetch_sub)                \
+  COIL_EACH_INT64(F, FETCH_AND, h_fetch_and) COIL_EACH_INT64(F, FETCH_OR, h_fetch_or)                  \
+  COIL_EACH_INT64(F, FETCH_XOR, h_fetch_xor) COIL_EACH_INT64(F, FETCH_MIN, h_fetch_min)                \
+  COIL_EACH_INT64(F, FETCH_MAX, h_fetch_max)                                                           \
+  F(FENCE, h_fence) F(PREFETCH, h_prefetch) F(CACHE_ZERO, h_cache_zero)                                \
+  F(MCOPY, h_mcopy) F(MMOVE, h_mmove) F(MFILL, h_mfill) F(MCMP, h_mcmp)                                \
+  F(SALLOC, h_salloc) F(SALLOC_DYN, h_salloc_dyn) F(BADDR, h_baddr)                                    \
+  F(VLOAD, h_vload) F(VSTORE, h_vstore)                                                                \
+  COIL_EACH_SIZE8(F, VLOADM, h_vloadm) COIL_EACH_SIZE8(F, VSTOREM, h_vstorem)                          \
+  COIL_EACH_SIZE8(F, VGATHER_i8, h_vgather_i8) COIL_EACH_SIZE8(F, VGATHER_i16, h_vgather_i16)          \
+  COIL_EACH_SIZE8(F, VGATHER_i32, h_vgather_i32) COIL_EACH_SIZE8(F, VGATHER_i64, h_vgather_i64)        \
+  COIL_EACH_SIZE8(F, VSCATTER_i8, h_vscatter_i8) COIL_EACH_SIZE8(F, VSCATTER_i16, h_vscatter_i16)      \
+  COIL_EACH_SIZE8(F, VSCATTER_i32, h_vscatter_i32) COIL_EACH_SIZE8(F, VSCATTER_i64, h_vscatter_i64)    \
+  COIL_EACH_SIZE8(F, VSPLAT, h_vsplat) COIL_EACH_SIZE8(F, VEXTRACT, h_vextract)                        \
+  COIL_EACH_SIZE8(F, VINSERT, h_vinsert) COIL_EACH_SIZE8(F, VSHUFFLE, h_vshuffle)                      \
+  COIL_EACH_SIZE8(F, VPERMUTE, h_vpermute)                                                             \
+  COIL_EACH_LANE(F, VADD, h_vadd) COIL_EACH_LANE(F, VSUB, h_vsub) COIL_EACH_LANE(F, VMUL, h_vmul)      \
+  COIL_EACH_LANE(F, VDIV, h_vdiv) COIL_EACH_LANE(F, VMIN, h_vmin) COIL_EACH_LANE(F, VMAX, h_vmax)      \
+  F(VAND, h_vand) F(VOR, h_vor) F(VXOR, h_vxor) F(VSELECT, h_vselect)                                  \
+  COIL_EACH_INT64(F, VSHL, h_vshl) COIL_EACH_INT64(F, VSHR, h_vshr)                                    \
+  COIL_EACH_FP(F, VFMA, h_vfma) COIL_EACH_LANE(F, VCMP, h_vcmp) COIL_EACH_LANE(F, VREDUCE, h_vreduce)  \
+  COIL_EACH_INT64(F, VADDSAT, h_vaddsat) COIL_EACH_INT64(F, VSUBSAT, h_vsubsat)                        \
+  COIL_VCVT(F) F(VSETVL, h_vsetvl) COIL_DOT(F)                                                         \
+  F(TZERO, h_tzero) F(TLOAD, h_tload) F(TSTORE, h_tstore) COIL_TMMA(F)
+
+// Handlers that set the flags as their straight counterpart does and then
+// branch, a CMP merged with the BR after it
+#define COIL_BRANCHES(F) COIL_EACH_NUM(F, CMPBR, h_cmp)
+
+// Handlers that change ip themselves, written out in the dispatch loop
+#define COIL_CONTROL(C) \
+  C(BR) C(BR_COND) C(BRI) C(SWITCH_1) C(SWITCH_2) C(SWITCH_4) C(SWITCH_8) C(SWITCHS) C(CALL) C(TAIL) C(RET)
+
+enum handler : uint16_t {
+#define COIL_ENUM(name, ...) H_##name,
+  COIL_STRAIGHT(COIL_ENUM) COIL_BRANCHES(COIL_ENUM) COIL_CONTROL(COIL_ENUM)
+#undef COIL_ENUM
+  H_COUNT
+};
+
+// Flags of a function, BRANCH_COND tests them through cond_table
+inline constexpr uint8_t FL_Z = 1 << 0, FL_S = 1 << 1, FL_C = 1 << 2, FL_O = 1 << 3;
+inline constexpr uint8_t FL_LT = 1 << 4, FL_EQ = 1 << 5, FL_GT = 1 << 6;
+
+// record::mode bits of the vector handlers
+inline constexpr uint8_t MODE_VS = 1 << 0;     // TYPE_VS, obeys the active length
+inline constexpr uint8_t MODE_MASK = 1 << 1;   // has a mask operand
+inline constexpr uint8_t MODE_VCOUNT = 1 << 2; // VSHL and VSHR count is a vector
+
+// One decoded instruction. a holds frame offsets of the operands, except
+// where a handler says otherwise, branch targets are record indices.
+struct record {
+  const void *handler;  // label of the handler, threaded dispatch only
+  uint16_t op;          // enum handler
+  uint8_t aux;          // BRANCH_COND, MEMORY_ORDER, ROUND, lane size, ...
+  uint8_t mode;
+  uint32_t n;           // size in bytes, lane count, ...
+  uint32_t a[6];
+};
+
+// A call, arguments are frame offsets in extra from args, results likewise
+struct call_site {
+  function *target;    // nullptr when the callee is the pointer in slot
+  uint32_t slot;
+  uint32_t args, nargs;
+  uint32_t rets, nrets;
+};
+
+struct decoded {
+  std::vector<record> code;
+  std::vector<uint32_t> extra;
+  std::vector<call_site> calls;
+  std::vector<std::pair<uint64_t, uint32_t>> cases;  // SWITCHS keys, ordered, and targets
+  std::vector<std::pair<uint32_t, uint32_t>> params;  // ENTER variables, offset and size
+  std::vector<uint8_t> init;  // bytes of the frame from init_begin, constants
+  uint32_t init_begin = 0;
+  uint32_t frame_size = 0;
+};
+
+// Frames are allocated from a stack per thread, frames of the same thread
+// never move so pointers to SALLOC memory stay valid
+struct thread_stack {
+  static constexpr size_t capacity = size_t{64} << 20;
+  std::unique_ptr<uint8_t[]> memory;
+  uint8_t *top = nullptr;
+  uint8_t *limit = nullptr;
+  std::vector<uint8_t> scratch;  // arguments of a tail call
+
+  uint8_t *alloc(size_t size, size_t align = 64) {
+    if (!memory) {
+      memory.reset(new uint8_t[capacity + 64]);
+      top = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(memory.get()) + 63) & ~uintptr_t{63});
+      limit = top + capacity;
+    }
+    uint8_t *p = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(top) + align - 1) & ~uintptr_t(align - 1));
+    if (size > static_cast<size_t>(limit - p)) throw error("engine: stack overflow");
+    top = p + size;
+    return p;
+  }
+};
+
+thread_stack &this_thread_stack();
+
+// Runs fn in the frame f, which the caller has allocated and initialized
+// with the constants and arguments. RET writes result i to rf + ro[i].
+void execute(const decoded &fn, uint8_t *f, uint8_t *rf, const uint32_t *ro, uint32_t nr);
+
+// The handler label addresses of the dispatch loop, indexed by enum handler
+const void *const *handler_labels();
+
+// Decodes a function, v1/impl.md
+std::unique_ptr<decoded> decode(engine::image &img, function &fn);
+
+// Frame setup shared by engine::call, CALL and tail calls
+inline void init_frame(const decoded &d, uint8_t *f) {
+  if (!d.init.empty()) std::memcpy(f + d.init_begin, d.init.data(), d.init.size());
+}
+
+}  // namespace coil::detail
+
+namespace coil {
+
+class function {
+ public:
+  engine::image *image = nullptr;
+  uint32_t symbol = 0;
+  uint32_t section = 0;
+  uint64_t offset = 0;
+  uint64_t size = 0;
+  std::string name;
+
+  const detail::decoded &code() {
+    std::call_once(once_, [this] { decoded_ = detail::decode(*image, *this); });
+    return *decoded_;
+  }
+
+ private:
+  std::once_flag once_;
+  std::unique_ptr<detail::decoded> decoded_;
+};
+
+struct engine::image {
+  coil::engine *engine = nullptr;
+  coil::object object;
+  std::vector<std::unique_ptr<uint8_t[]>> memory;
+  std::vector<uint8_t *> base;  // per section, the loaded data, nullptr otherwise
+  std::vector<std::unique_ptr<function>> functions;
+  std::vector<function *> by_symbol;
+
+  explicit image(coil::object obj) : object(std::move(obj)) {}
+
+  // Address of a symbol for data and function pointers, resolving undefined
+  // symbols across loaded objects. Throws for a symbol with no address.
+  uint64_t address(uint32_t symbol) const;
+  // The function a symbol names, resolving undefined symbols, or nullptr
+  function *callee(uint32_t symbol) const;
+};
+
+}  // namespace coil
+
+#endif
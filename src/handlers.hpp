@@ -0,0 +1,1005 @@
+// The handlers of the dispatch loop, one per record handler (engine_impl.hpp).
+// Each reads its operands from the frame at the offsets in the record and
+// writes its result back, the comment above a handler gives the fields it
+// uses when they differ from dest in a[0] followed by the sources.
+//
+// Only included by interp.cpp.
+
+#ifndef COIL_HANDLERS_HPP
+#define COIL_HANDLERS_HPP
+
+#include "engine_impl.hpp"
+
+#include <coil/isa.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+namespace coil::detail {
+
+struct state {
+  uint8_t *f;            // frame
+  const record *code;    // first record of the function
+  thread_stack *stack;
+  uint32_t vl;           // active length of TYPE_VS operations
+  uint8_t flags;
+};
+
+#define COIL_OP(i) (st.f + ip->a[i])
+
+template <class T>
+inline T get(const uint8_t *p) {
+  T v;
+  std::memcpy(&v, p, sizeof v);
+  return v;
+}
+
+template <class T>
+inline void put(uint8_t *p, T v) {
+  std::memcpy(p, &v, sizeof v);
+}
+
+template <class T>
+inline T *ptr(const uint8_t *p) {
+  return reinterpret_cast<T *>(get<uint64_t>(p));
+}
+
+// Unsigned integers of 1 to 16 bytes, held in the low bytes of a u128
+inline u128 load_u(const uint8_t *p, size_t size) {
+  u128 v = 0;
+  std::memcpy(&v, p, size);
+  return v;
+}
+
+inline void store_u(uint8_t *p, u128 v, size_t size) { std::memcpy(p, &v, size); }
+
+template <int N>
+using uint_n = std::conditional_t<N == 1, u8, std::conditional_t<N == 2, u16, std::conditional_t<N == 4, u32, std::conditional_t<N == 8, u64, u128>>>>;
+
+template <class T>
+inline constexpr bool is_fp = std::is_same_v<T, f32> || std::is_same_v<T, f64>;
+template <class T>
+inline constexpr bool is_signed = std::is_same_v<T, i8> || std::is_same_v<T, i16> || std::is_same_v<T, i32> ||
+                                  std::is_same_v<T, i64> || std::is_same_v<T, i128>;
+template <class T>
+inline constexpr int bits = static_cast<int>(sizeof(T) * 8);
+
+template <class T>
+using uns = uint_n<static_cast<int>(sizeof(T))>;
+
+template <class T>
+constexpr T max_of() {
+  if constexpr (is_signed<T>) return static_cast<T>(static_cast<uns<T>>(~uns<T>(0)) >> 1);
+  else return static_cast<T>(~T(0));
+}
+
+template <class T>
+constexpr T min_of() {
+  if constexpr (is_signed<T>) return static_cast<T>(-max_of<T>() - 1);
+  else return T(0);
+}
+
+// Widening of a bf16 is exact
+inline f32 to_f32(bf16 v) { return std::bit_cast<f32>(static_cast<u32>(v.bits) << 16); }
+
+template <class T>
+inline auto widen(T v) {
+  if constexpr (std::is_same_v<T, bf16>) return to_f32(v);
+  else return v;
+}
+
+// BRANCH_COND of the flags, cond_table[cond][flags]
+constexpr std::array<std::array<bool, 128>, 14> make_cond_table() {
+  std::array<std::array<bool, 128>, 14> t{};
+  for (unsigned f = 0; f < 128; f++) {
+    t[BRANCH_COND_EQ][f] = f & FL_EQ;
+    t[BRANCH_COND_NE][f] = !(f & FL_EQ);
+    t[BRANCH_COND_GE][f] = f & (FL_GT | FL_EQ);
+    t[BRANCH_COND_LT][f] = f & FL_LT;
+    t[BRANCH_COND_GT][f] = f & FL_GT;
+    t[BRANCH_COND_LE][f] = f & (FL_LT | FL_EQ);
+    t[BRANCH_COND_Z][f] = f & FL_Z;
+    t[BRANCH_COND_NZ][f] = !(f & FL_Z);
+    t[BRANCH_COND_C][f] = f & FL_C;
+    t[BRANCH_COND_NC][f] = !(f & FL_C);
+    t[BRANCH_COND_O][f] = f & FL_O;
+    t[BRANCH_COND_NO][f] = !(f & FL_O);
+    t[BRANCH_COND_S][f] = f & FL_S;
+    t[BRANCH_COND_NS][f] = !(f & FL_S);
+  }
+  return t;
+}
+
+inline constexpr auto cond_table = make_cond_table();
+
+inline std::memory_order order(uint8_t p) {
+  switch (p) {
+    case MEMORY_ORDER_RELAXED: return std::memory_order_relaxed;
+    case MEMORY_ORDER_ACQUIRE: return std::memory_order_acquire;
+    case MEMORY_ORDER_RELEASE: return std::memory_order_release;
+    case MEMORY_ORDER_ACQ_REL: return std::memory_order_acq_rel;
+    default: return std::memory_order_seq_cst;
+  }
+}
+
+// Moves, loads and stores
+
+template <int N>
+inline void h_mov(state &st, const record *ip) {
+  std::memcpy(COIL_OP(0), COIL_OP(1), N);
+}
+
+// a[1] pointer
+template <int N>
+inline void h_load(state &st, const record *ip) {
+  std::memcpy(COIL_OP(0), ptr<uint8_t>(COIL_OP(1)), N);
+}
+
+// a[0] pointer, a[1] value
+template <int N>
+inline void h_store(state &st, const record *ip) {
+  std::memcpy(ptr<uint8_t>(COIL_OP(0)), COIL_OP(1), N);
+}
+
+// aux MEMORY_ORDER
+template <int N>
+inline void h_load_atomic(state &st, const record *ip) {
+  using U = uint_n<N>;
+  put<U>(COIL_OP(0), std::atomic_ref<U>(*ptr<U>(COIL_OP(1))).load(order(ip->aux)));
+}
+
+template <int N>
+inline void h_store_atomic(state &st, const record *ip) {
+  using U = uint_n<N>;
+  std::atomic_ref<U>(*ptr<U>(COIL_OP(0))).store(get<U>(COIL_OP(1)), order(ip->aux));
+}
+
+template <int N>
+inline void h_xchg(state &st, const record *ip) {
+  using U = uint_n<N>;
+  put<U>(COIL_OP(0), std::atomic_ref<U>(*ptr<U>(COIL_OP(1))).exchange(get<U>(COIL_OP(2)), order(ip->aux)));
+}
+
+// a[2] expected, a[3] desired, aux success order, mode failure order, n weak
+template <int N>
+inline void h_cas(state &st, const record *ip) {
+  using U = uint_n<N>;
+  std::atomic_ref<U> a(*ptr<U>(COIL_OP(1)));
+  U expected = get<U>(COIL_OP(2));
+  bool ok = ip->n ? a.compare_exchange_weak(expected, get<U>(COIL_OP(3)), order(ip->aux), order(ip->mode))
+                  : a.compare_exchange_strong(expected, get<U>(COIL_OP(3)), order(ip->aux), order(ip->mode));
+  put<U>(COIL_OP(0), expected);
+  st.flags = ok ? FL_Z : 0;
+}
+
+template <uint8_t Op, class T>
+inline void h_fetch(state &st, const record *ip) {
+  std::atomic_ref<T> a(*ptr<T>(COIL_OP(1)));
+  T v = get<T>(COIL_OP(2));
+  std::memory_order o = order(ip->aux);
+  T old;
+  if constexpr (Op == FETCH_OP_ADD) old = a.fetch_add(v, o);
+  else if constexpr (Op == FETCH_OP_SUB) old = a.fetch_sub(v, o);
+  else if constexpr (Op == FETCH_OP_AND) old = a.fetch_and(v, o);
+  else if constexpr (Op == FETCH_OP_OR) old = a.fetch_or(v, o);
+  else if constexpr (Op == FETCH_OP_XOR) old = a.fetch_xor(v, o);
+  else {
+    old = a.load(std::memory_order_relaxed);
+    while (!a.compare_exchange_weak(old, Op == FETCH_OP_MIN ? std::min(old, v) : std::max(old, v), o, std::memory_order_relaxed)) {
+    }
+  }
+  put<T>(COIL_OP(0), old);
+}
+
+template <class T> inline void h_fetch_add(state &st, const record *ip) { h_fetch<FETCH_OP_ADD, T>(st, ip); }
+template <class T> inline void h_fetch_sub(state &st, const record *ip) { h_fetch<FETCH_OP_SUB, T>(st, ip); }
+template <class T> inline void h_fetch_and(state &st, const record *ip) { h_fetch<FETCH_OP_AND, T>(st, ip); }
+template <class T> inline void h_fetch_or(state &st, const record *ip) { h_fetch<FETCH_OP_OR, T>(st, ip); }
+template <class T> inline void h_fetch_xor(state &st, const record *ip) { h_fetch<FETCH_OP_XOR, T>(st, ip); }
+template <class T> inline void h_fetch_min(state &st, const record *ip) { h_fetch<FETCH_OP_MIN, T>(st, ip); }
+template <class T> inline void h_fetch_max(state &st, const record *ip) { h_fetch<FETCH_OP_MAX, T>(st, ip); }
+
+// aux MEMORY_ORDER, mode FENCE_SCOPE
+inline void h_fence(state &, const record *ip) {
+  if (ip->mode == FENCE_SCOPE_SIGNAL) std::atomic_signal_fence(order(ip->aux));
+  else std::atomic_thread_fence(order(ip->aux));
+}
+
+// a[0] pointer, aux PREFETCH_READ or PREFETCH_WRITE
+inline void h_prefetch(state &st, const record *ip) {
+  const void *p = ptr<const void>(COIL_OP(0));
+  if (ip->aux == PREFETCH_WRITE) __builtin_prefetch(p, 1, 3);
+  else __builtin_prefetch(p, 0, 3);
+}
+
+inline void h_cache_zero(state &st, const record *ip) { std::memset(ptr<void>(COIL_OP(0)), 0, 64); }
+
+// a[0] dest pointer, a[1] source pointer or value, a[2] length
+inline void h_mcopy(state &st, const record *ip) {
+  if (uint64_t n = get<uint64_t>(COIL_OP(2))) std::memcpy(ptr<void>(COIL_OP(0)), ptr<const void>(COIL_OP(1)), n);
+}
+
+inline void h_mmove(state &st, const record *ip) {
+  if (uint64_t n = get<uint64_t>(COIL_OP(2))) std::memmove(ptr<void>(COIL_OP(0)), ptr<const void>(COIL_OP(1)), n);
+}
+
+inline void h_mfill(state &st, const record *ip) {
+  if (uint64_t n = get<uint64_t>(COIL_OP(2))) std::memset(ptr<void>(COIL_OP(0)), *COIL_OP(1), n);
+}
+
+// a[3] length, aux size of dest
+inline void h_mcmp(state &st, const record *ip) {
+  uint64_t n = get<uint64_t>(COIL_OP(3));
+  int r = n ? std::memcmp(ptr<const void>(COIL_OP(1)), ptr<const void>(COIL_OP(2)), n) : 0;
+  store_u(COIL_OP(0), static_cast<u128>(static_cast<i128>(r < 0 ? -1 : r > 0)), ip->aux);
+  st.flags = r == 0 ? FL_Z : 0;
+}
+
+// a[1] offset of the slot in the frame
+inline void h_salloc(state &st, const record *ip) { put<uint64_t>(COIL_OP(0), reinterpret_cast<uint64_t>(st.f + ip->a[1])); }
+
+// a[1] size, aux log2 of the alignment
+inline void h_salloc_dyn(state &st, const record *ip) {
+  put<uint64_t>(COIL_OP(0), reinterpret_cast<uint64_t>(st.stack->alloc(get<uint64_t>(COIL_OP(1)), size_t{1} << ip->aux)));
+}
+
+// a[1] target record
+inline void h_baddr(state &st, const record *ip) { put<const record *>(COIL_OP(0), st.code + ip->a[1]); }
+
+// Core arithmetic
+
+template <class T>
+inline void h_add(state &st, const record *ip) {
+  if constexpr (is_fp<T>) put<T>(COIL_OP(0), get<T>(COIL_OP(1)) + get<T>(COIL_OP(2)));
+  else put<T>(COIL_OP(0), static_cast<T>(static_cast<uns<T>>(get<T>(COIL_OP(1))) + static_cast<uns<T>>(get<T>(COIL_OP(2)))));
+}
+
+template <class T>
+inline void h_sub(state &st, const record *ip) {
+  if constexpr (is_fp<T>) put<T>(COIL_OP(0), get<T>(COIL_OP(1)) - get<T>(COIL_OP(2)));
+  else put<T>(COIL_OP(0), static_cast<T>(static_cast<uns<T>>(get<T>(COIL_OP(1))) - static_cast<uns<T>>(get<T>(COIL_OP(2)))));
+}
+
+template <class T>
+inline void h_mul(state &st, const record *ip) {
+  if constexpr (is_fp<T>) put<T>(COIL_OP(0), get<T>(COIL_OP(1)) * get<T>(COIL_OP(2)));
+  else {
+    // Promoted to at least unsigned int so that narrow values can not overflow int
+    using W = std::conditional_t<(sizeof(T) < sizeof(unsigned)), unsigned, uns<T>>;
+    put<T>(COIL_OP(0), static_cast<T>(static_cast<W>(static_cast<uns<T>>(get<T>(COIL_OP(1)))) * static_cast<W>(static_cast<uns<T>>(get<T>(COIL_OP(2))))));
+  }
+}
+
+template <class T>
+inline void h_div(state &st, const record *ip) { put<T>(COIL_OP(0), static_cast<T>(get<T>(COIL_OP(1)) / get<T>(COIL_OP(2)))); }
+
+template <class T>
+inline void h_rem(state &st, const record *ip) { put<T>(COIL_OP(0), static_cast<T>(get<T>(COIL_OP(1)) % get<T>(COIL_OP(2)))); }
+
+template <class T>
+inline void h_neg(state &st, const record *ip) {
+  if constexpr (is_fp<T>) put<T>(COIL_OP(0), -get<T>(COIL_OP(1)));
+  else put<T>(COIL_OP(0), static_cast<T>(uns<T>(0) - static_cast<uns<T>>(get<T>(COIL_OP(1)))));
+}
+
+template <class T>
+inline uint8_t arith_flags(uns<T> r, bool carry, bool overflow) {
+  return (r == 0 ? FL_Z : 0) | ((r >> (bits<T> - 1)) & 1 ? FL_S : 0) | (carry ? FL_C : 0) | (overflow ? FL_O : 0);
+}
+
+template <class T>
+inline void h_add_flags(state &st, const record *ip) {
+  using U = uns<T>;
+  U a = static_cast<U>(get<T>(COIL_OP(1))), b = static_cast<U>(get<T>(COIL_OP(2))), r = static_cast<U>(a + b);
+  put<T>(COIL_OP(0), static_cast<T>(r));
+  st.flags = arith_flags<T>(r, r < a, (static_cast<U>((a ^ r) & (b ^ r)) >> (bits<T> - 1)) & 1);
+}
+
+template <class T>
+inline void h_sub_flags(state &st, const record *ip) {
+  using U = uns<T>;
+  U a = static_cast<U>(get<T>(COIL_OP(1))), b = static_cast<U>(get<T>(COIL_OP(2))), r = static_cast<U>(a - b);
+  put<T>(COIL_OP(0), static_cast<T>(r));
+  st.flags = arith_flags<T>(r, a < b, (static_cast<U>((a ^ b) & (a ^ r)) >> (bits<T> - 1)) & 1);
+}
+
+template <class T>
+inline void h_neg_flags(state &st, const record *ip) {
+  using U = uns<T>;
+  U a = static_cast<U>(get<T>(COIL_OP(1))), r = static_cast<U>(U(0) - a);
+  put<T>(COIL_OP(0), static_cast<T>(r));
+  st.flags = arith_flags<T>(r, a != 0, (static_cast<U>(a & r) >> (bits<T> - 1)) & 1);
+}
+
+template <class T>
+inline void h_and(state &st, const record *ip) { put<T>(COIL_OP(0), static_cast<T>(get<T>(COIL_OP(1)) & get<T>(COIL_OP(2)))); }
+template <class T>
+inline void h_or(state &st, const record *ip) { put<T>(COIL_OP(0), static_cast<T>(get<T>(COIL_OP(1)) | get<T>(COIL_OP(2)))); }
+template <class T>
+inline void h_xor(state &st, const record *ip) { put<T>(COIL_OP(0), static_cast<T>(get<T>(COIL_OP(1)) ^ get<T>(COIL_OP(2)))); }
+template <class T>
+inline void h_not(state &st, const record *ip) { put<T>(COIL_OP(0), static_cast<T>(~get<T>(COIL_OP(1)))); }
+
+// A count of the width or more is unspecified, it gives zero or the sign
+template <class T>
+inline T shift_left(T v, uns<T> c) {
+  return c >= bits<T> ? T(0) : static_cast<T>(static_cast<uns<T>>(v) << c);
+}
+
+template <class T>
+inline T shift_right(T v, uns<T> c) {
+  if constexpr (is_signed<T>) return static_cast<T>(v >> (c >= bits<T> ? bits<T> - 1 : static_cast<int>(c)));
+  else return c >= bits<T> ? T(0) : static_cast<T>(v >> c);
+}
+
+template <class T>
+inline void h_shl(state &st, const record *ip) {
+  put<T>(COIL_OP(0), shift_left(get<T>(COIL_OP(1)), static_cast<uns<T>>(get<T>(COIL_OP(2)))));
+}
+
+template <class T>
+inline void h_shr(state &st, const record *ip) {
+  put<T>(COIL_OP(0), shift_right(get<T>(COIL_OP(1)), static_cast<uns<T>>(get<T>(COIL_OP(2)))));
+}
+
+template <class T>
+inline void h_rol(state &st, const record *ip) {
+  using U = uns<T>;
+  U v = static_cast<U>(get<T>(COIL_OP(1))), c = static_cast<U>(static_cast<U>(get<T>(COIL_OP(2))) % bits<T>);
+  put<T>(COIL_OP(0), static_cast<T>(c ? static_cast<U>(v << c) | static_cast<U>(v >> (bits<T> - c)) : v));
+}
+
+template <class T>
+inline void h_ror(state &st, const record *ip) {
+  using U = uns<T>;
+  U v = static_cast<U>(get<T>(COIL_OP(1))), c = static_cast<U>(static_cast<U>(get<T>(COIL_OP(2))) % bits<T>);
+  put<T>(COIL_OP(0), static_cast<T>(c ? static_cast<U>(v >> c) | static_cast<U>(v << (bits<T> - c)) : v));
+}
+
+// a[0] and a[1] the sources. Integers also get the flags of a[0] - a[1].
+template <class T>
+inline void h_cmp(state &st, const record *ip) {
+  T a = get<T>(COIL_OP(0)), b = get<T>(COIL_OP(1));
+  uint8_t rel = a < b ? FL_LT : a == b ? FL_EQ : a > b ? FL_GT : 0;
+  if constexpr (is_fp<T>) {
+    st.flags = rel;
+  } else {
+    using U = uns<T>;
+    U ua = static_cast<U>(a), ub = static_cast<U>(b), r = static_cast<U>(ua - ub);
+    st.flags = rel | arith_flags<T>(r, ua < ub, (static_cast<U>((ua ^ ub) & (ua ^ r)) >> (bits<T> - 1)) & 1);
+  }
+}
+
+// aux BRANCH_COND
+template <int N>
+inline void h_sel(state &st, const record *ip) {
+  std::memcpy(COIL_OP(0), cond_table[ip->aux][st.flags] ? COIL_OP(1) : COIL_OP(2), N);
+}
+
+template <class T>
+inline void h_min(state &st, const record *ip) {
+  T a = get<T>(COIL_OP(1)), b = get<T>(COIL_OP(2));
+  if constexpr (is_fp<T>) put<T>(COIL_OP(0), std::fmin(a, b));
+  else put<T>(COIL_OP(0), b < a ? b : a);
+}
+
+template <class T>
+inline void h_max(state &st, const record *ip) {
+  T a = get<T>(COIL_OP(1)), b = get<T>(COIL_OP(2));
+  if constexpr (is_fp<T>) put<T>(COIL_OP(0), std::fmax(a, b));
+  else put<T>(COIL_OP(0), a < b ? b : a);
+}
+
+template <class T>
+inline void h_abs(state &st, const record *ip) {
+  T a = get<T>(COIL_OP(1));
+  if constexpr (is_fp<T>) put<T>(COIL_OP(0), std::fabs(a));
+  else if constexpr (is_signed<T>) put<T>(COIL_OP(0), a < 0 ? static_cast<T>(uns<T>(0) - static_cast<uns<T>>(a)) : a);
+  else put<T>(COIL_OP(0), a);
+}
+
+template <class T>
+inline void h_fma(state &st, const record *ip) { put<T>(COIL_OP(0), std::fma(get<T>(COIL_OP(1)), get<T>(COIL_OP(2)), get<T>(COIL_OP(3)))); }
+
+template <class T>
+inline void h_sqrt(state &st, const record *ip) { put<T>(COIL_OP(0), std::sqrt(get<T>(COIL_OP(1)))); }
+
+// Bit operations, N the size of the source and aux the size of dest
+
+inline int popcount128(u128 v) { return std::popcount(static_cast<u64>(v)) + std::popcount(static_cast<u64>(v >> 64)); }
+inline int ctz128(u128 v) {
+  return static_cast<u64>(v) ? std::countr_zero(static_cast<u64>(v)) : 64 + std::countr_zero(static_cast<u64>(v >> 64));
+}
+
+template <int N>
+inline void h_popcnt(state &st, const record *ip) { store_u(COIL_OP(0), popcount128(load_u(COIL_OP(1), N)), ip->aux); }
+
+template <int N>
+inline void h_clz(state &st, const record *ip) {
+  u128 v = load_u(COIL_OP(1), N);
+  int width = 0;
+  for (u128 w = v; w; w >>= 1) width++;
+  store_u(COIL_OP(0), static_cast<u128>(N * 8 - width), ip->aux);
+}
+
+template <int N>
+inline void h_ctz(state &st, const record *ip) {
+  u128 v = load_u(COIL_OP(1), N);
+  store_u(COIL_OP(0), static_cast<u128>(v ? ctz128(v) : N * 8), ip->aux);
+}
+
+template <int N>
+inline void h_ffs(state &st, const record *ip) {
+  u128 v = load_u(COIL_OP(1), N);
+  store_u(COIL_OP(0), static_cast<u128>(v ? ctz128(v) + 1 : 0), ip->aux);
+}
+
+// Up to 64 bits of a bit array starting at any bit, reading only the bytes
+// holding them
+inline u64 read_bits(const uint8_t *base, u64 pos, unsigned count) {
+  const uint8_t *p = base + pos / 8;
+  unsigned shift = pos % 8, bytes = (shift + count + 7) / 8;
+  u128 v = 0;
+  std::memcpy(&v, p, bytes);
+  v >>= shift;
+  return count == 64 ? static_cast<u64>(v) : static_cast<u64>(v) & ((u64{1} << count) - 1);
+}
+
+inline void write_bits(uint8_t *base, u64 pos, unsigned count, u64 value) {
+  uint8_t *p = base + pos / 8;
+  unsigned shift = pos % 8, bytes = (shift + count + 7) / 8;
+  u128 v = 0, mask = (count == 64 ? ~u128{0} >> 64 : (u128{1} << count) - 1) << shift;
+  std::memcpy(&v, p, bytes);
+  v = (v & ~mask) | ((static_cast<u128>(value) << shift) & mask);
+  std::memcpy(p, &v, bytes);
+}
+
+// a[1] bitmap, a[2] start, a[3] count
+inline void h_bpop(state &st, const record *ip) {
+  const uint8_t *map = ptr<const uint8_t>(COIL_OP(1));
+  u64 pos = get<u64>(COIL_OP(2)), end = pos + get<u64>(COIL_OP(3)), n = 0;
+  for (; pos < end; pos += 64) n += std::popcount(read_bits(map, pos, static_cast<unsigned>(std::min<u64>(64, end - pos))));
+  store_u(COIL_OP(0), n, ip->aux);
+}
+
+// mode BFIND_SET or BFIND_CLEAR
+inline void h_bfind(state &st, const record *ip) {
+  const uint8_t *map = ptr<const uint8_t>(COIL_OP(1));
+  u64 pos = get<u64>(COIL_OP(2)), end = pos + get<u64>(COIL_OP(3));
+  for (; pos < end; pos += 64) {
+    unsigned count = static_cast<unsigned>(std::min<u64>(64, end - pos));
+    u64 w = read_bits(map, pos, count);
+    if (ip->mode == BFIND_CLEAR) w = ~w & (count == 64 ? ~u64{0} : (u64{1} << count) - 1);
+    if (w) {
+      store_u(COIL_OP(0), pos + std::countr_zero(w), ip->aux);
+      st.flags = 0;
+      return;
+    }
+  }
+  store_u(COIL_OP(0), end, ip->aux);
+  st.flags = FL_Z;
+}
+
+// a[0] dest, a[1] dest start, a[2] src1, a[3] src2, a[4] src start,
+// a[5] count, aux BITOP
+inline void h_bop(state &st, const record *ip) {
+  uint8_t *dest = ptr<uint8_t>(COIL_OP(0));
+  const uint8_t *s1 = ptr<const uint8_t>(COIL_OP(2)), *s2 = ptr<const uint8_t>(COIL_OP(3));
+  u64 d = get<u64>(COIL_OP(1)), s = get<u64>(COIL_OP(4)), count = get<u64>(COIL_OP(5)), any = 0;
+  for (u64 i = 0; i < count; i += 64) {
+    unsigned n = static_cast<unsigned>(std::min<u64>(64, count - i));
+    u64 a = read_bits(s1, s + i, n), b = read_bits(s2, s + i, n), r;
+    switch (ip->aux) {
+      case BITOP_AND: r = a & b; break;
+      case BITOP_OR: r = a | b; break;
+      case BITOP_XOR: r = a ^ b; break;
+      default: r = a & ~b; break;
+    }
+    any |= r;
+    write_bits(dest, d + i, n, r);
+  }
+  st.flags = any ? 0 : FL_Z;
+}
+
+// Extended integer
+
+// a[0] dest, a[1] carry out, a[2] src1, a[3] src2, a[4] carry in
+template <int N>
+inline void h_addc(state &st, const record *ip) {
+  using U = uint_n<N>;
+  U a = get<U>(COIL_OP(2)), b = get<U>(COIL_OP(3));
+  U r = static_cast<U>(a + b), c = r < a;
+  U r2 = static_cast<U>(r + (*COIL_OP(4) & 1));
+  c |= r2 < r;
+  put<U>(COIL_OP(0), r2);
+  *COIL_OP(1) = static_cast<uint8_t>(c);
+}
+
+template <int N>
+inline void h_subb(state &st, const record *ip) {
+  using U = uint_n<N>;
+  U a = get<U>(COIL_OP(2)), b = get<U>(COIL_OP(3)), in = *COIL_OP(4) & 1;
+  U r = static_cast<U>(a - b), c = a < b;
+  c |= r < in;
+  put<U>(COIL_OP(0), static_cast<U>(r - in));
+  *COIL_OP(1) = static_cast<uint8_t>(c);
+}
+
+template <class T>
+using twice = std::conditional_t<is_signed<T>, std::conditional_t<sizeof(T) == 1, i16, std::conditional_t<sizeof(T) == 2, i32, std::conditional_t<sizeof(T) == 4, i64, i128>>>,
+                                 std::conditional_t<sizeof(T) == 1, u16, std::conditional_t<sizeof(T) == 2, u32, std::conditional_t<sizeof(T) == 4, u64, u128>>>>;
+
+// a[0] dest high, a[1] dest low, a[2] src1, a[3] src2
+template <class T>
+inline void h_mulw(state &st, const record *ip) {
+  using W = twice<T>;
+  W p = static_cast<W>(static_cast<W>(get<T>(COIL_OP(2))) * static_cast<W>(get<T>(COIL_OP(3))));
+  put<T>(COIL_OP(1), static_cast<T>(p));
+  put<T>(COIL_OP(0), static_cast<T>(p >> bits<T>));
+}
+
+template <class T>
+inline T add_sat(T a, T b) {
+  T r;
+  if (!__builtin_add_overflow(a, b, &r)) return r;
+  return is_signed<T> && b < T(0) ? min_of<T>() : max_of<T>();
+}
+
+template <class T>
+inline T sub_sat(T a, T b) {
+  T r;
+  if (!__builtin_sub_overflow(a, b, &r)) return r;
+  if constexpr (is_signed<T>) return b < T(0) ? max_of<T>() : min_of<T>();
+  else return T(0);
+}
+
+template <class T>
+inline void h_addsat(state &st, const record *ip) { put<T>(COIL_OP(0), add_sat(get<T>(COIL_OP(1)), get<T>(COIL_OP(2)))); }
+template <class T>
+inline void h_subsat(state &st, const record *ip) { put<T>(COIL_OP(0), sub_sat(get<T>(COIL_OP(1)), get<T>(COIL_OP(2)))); }
+
+// Mixed precision, the product is exact in W
+template <class W, class N>
+inline void h_fmaw(state &st, const record *ip) {
+  W a = static_cast<W>(widen(get<N>(COIL_OP(1)))), b = static_cast<W>(widen(get<N>(COIL_OP(2))));
+  if constexpr (is_fp<W>) put<W>(COIL_OP(0), std::fma(a, b, get<W>(COIL_OP(3))));
+  else put<W>(COIL_OP(0), static_cast<W>(static_cast<uns<W>>(static_cast<uns<W>>(a) * static_cast<uns<W>>(b)) + static_cast<uns<W>>(get<W>(COIL_OP(3)))));
+}
+
+// Conversions, aux ROUND and mode SAT
+
+template <class F>
+constexpr int fp_digits = std::numeric_limits<F>::digits;
+
+// Compares the integral or infinite r with s exactly
+template <class F, class S>
+inline int compare(F r, S s) {
+  using I = std::conditional_t<is_signed<S>, i128, u128>;
+  if (std::isinf(r)) return r > 0 ? 1 : -1;
+  if (r >= std::ldexp(F(1), bits<I> - (is_signed<S> ? 1 : 0))) return 1;
+  if (!is_signed<S> && r < 0) return -1;
+  I ri = static_cast<I>(r), si = static_cast<I>(s);
+  return ri < si ? -1 : ri > si ? 1 : 0;
+}
+
+template <class F>
+inline F round_adjust(F r, int cmp, uint8_t round) {
+  // cmp is r compared with the exact value, r the nearest value to it
+  F inf = std::numeric_limits<F>::infinity();
+  switch (round) {
+    case ROUND_ZERO:
+      if ((r > 0 && cmp > 0) || (r < 0 && cmp < 0)) return std::nextafter(r, F(0));
+      return r;
+    case ROUND_UP: return cmp < 0 ? std::nextafter(r, inf) : r;
+    case ROUND_DOWN: return cmp > 0 ? std::nextafter(r, -inf) : r;
+    default: return r;
+  }
+}
+
+// The FP32 of v rounded to odd, exact before rounding to bf16 since FP32 has
+// more than two bits beyond those of bf16
+template <class S>
+inline f32 to_f32_odd(S v) {
+  f32 r;
+  int cmp;
+  if constexpr (std::is_same_v<S, f32>) {
+    return v;
+  } else if constexpr (std::is_same_v<S, f64>) {
+    if (std::isnan(v)) return static_cast<f32>(v);
+    r = static_cast<f32>(v);
+    cmp = static_cast<f64>(r) < v ? -1 : static_cast<f64>(r) > v ? 1 : 0;
+  } else {
+    r = static_cast<f32>(v);
+    cmp = compare(r, v);
+  }
+  if (cmp == 0) return r;
+  r = round_adjust(r, cmp, ROUND_ZERO);
+  return std::bit_cast<f32>(std::bit_cast<u32>(r) | 1);
+}
+
+inline bf16 f32_to_bf16(f32 v, uint8_t round) {
+  u32 b = std::bit_cast<u32>(v);
+  if (std::isnan(v)) return {static_cast<uint16_t>((b >> 16) | 0x40)};
+  u32 hi = b >> 16, lo = b & 0xFFFF;
+  bool negative = b >> 31;
+  switch (round) {
+    case ROUND_ZERO: break;
+    case ROUND_UP: hi += !negative && lo; break;
+    case ROUND_DOWN: hi += negative && lo; break;
+    default: hi += lo > 0x8000 || (lo == 0x8000 && (hi & 1)); break;
+  }
+  return {static_cast<uint16_t>(hi)};
+}
+
+template <class D, class S>
+inline D convert(S s, uint8_t round, bool sat) {
+  if constexpr (std::is_same_v<S, bf16>) {
+    return convert<D, f32>(to_f32(s), round, sat);
+  } else if constexpr (std::is_same_v<D, bf16>) {
+    return f32_to_bf16(to_f32_odd(s), round);
+  } else if constexpr (is_fp<D> && is_fp<S>) {
+    D r = static_cast<D>(s);
+    if constexpr (sizeof(D) < sizeof(S)) {
+      if (!std::isnan(s)) r = round_adjust(r, static_cast<S>(r) < s ? -1 : static_cast<S>(r) > s ? 1 : 0, round);
+    }
+    return r;
+  } else if constexpr (is_fp<D>) {
+    D r = static_cast<D>(s);
+    if (round != ROUND_NEAREST) r = round_adjust(r, compare(r, s), round);
+    return r;
+  } else if constexpr (is_fp<S>) {
+    // NaN and values out of range are unspecified without SAT, they clamp
+    if (std::isnan(s)) return D(0);
+    S r = round == ROUND_ZERO ? std::trunc(s) : round == ROUND_UP ? std::ceil(s) : round == ROUND_DOWN ? std::floor(s) : std::nearbyint(s);
+    if (r < static_cast<S>(min_of<D>())) return min_of<D>();
+    if (r >= std::ldexp(S(1), bits<D> - (is_signed<D> ? 1 : 0))) return max_of<D>();
+    return static_cast<D>(r);
+  } else {
+    if (sat) {
+      if constexpr (is_signed<S>) {
+        i128 v = static_cast<i128>(s);
+        if (v < 0 && (!is_signed<D> || v < static_cast<i128>(min_of<D>()))) return min_of<D>();
+        if (v > 0 && static_cast<u128>(v) > static_cast<u128>(max_of<D>())) return max_of<D>();
+      } else {
+        if (static_cast<u128>(s) > static_cast<u128>(max_of<D>())) return max_of<D>();
+      }
+    }
+    return static_cast<D>(s);
+  }
+}
+
+template <class D, class S>
+inline void h_cvt(state &st, const record *ip) { put<D>(COIL_OP(0), convert<D, S>(get<S>(COIL_OP(1)), ip->aux, ip->mode)); }
+
+// Vectors. n is the size of the vector in bytes unless given otherwise, the
+// active lanes are those below the active length with MODE_VS set.
+
+inline uint32_t active(const state &st, const record *ip, uint32_t lanes) {
+  return ip->mode & MODE_VS ? std::min(lanes, st.vl) : lanes;
+}
+
+template <class L>
+inline bool lane_on(const uint8_t *mask, uint32_t i) {
+  return get<uns<L>>(mask + i * sizeof(L)) != 0;
+}
+
+// a[1] pointer, aux lane size
+inline void h_vload(state &st, const record *ip) {
+  uint32_t lanes = ip->n / ip->aux;
+  std::memcpy(COIL_OP(0), ptr<const uint8_t>(COIL_OP(1)), active(st, ip, lanes) * ip->aux);
+}
+
+// a[0] pointer, a[1] vector
+inline void h_vstore(state &st, const record *ip) {
+  uint32_t lanes = ip->n / ip->aux;
+  std::memcpy(ptr<uint8_t>(COIL_OP(0)), COIL_OP(1), active(st, ip, lanes) * ip->aux);
+}
+
+// a[2] mask, N the lane size
+template <int N>
+inline void h_vloadm(state &st, const record *ip) {
+  using U = uint_n<N>;
+  const U *p = ptr<const U>(COIL_OP(1));
+  uint32_t lanes = ip->n / N, on = active(st, ip, lanes);
+  for (uint32_t i = 0; i < lanes; i++) put<U>(COIL_OP(0) + i * N, i < on && lane_on<U>(COIL_OP(2), i) ? p[i] : U(0));
+}
+
+template <int N>
+inline void h_vstorem(state &st, const record *ip) {
+  using U = uint_n<N>;
+  U *p = ptr<U>(COIL_OP(0));
+  uint32_t on = active(st, ip, ip->n / N);
+  for (uint32_t i = 0; i < on; i++)
+    if (lane_on<U>(COIL_OP(2), i)) p[i] = get<U>(COIL_OP(1) + i * N);
+}
+
+// a[1] base, a[2] index vector, a[3] mask with MODE_MASK, n lane count
+template <int N, class I>
+inline void h_vgather(state &st, const record *ip) {
+  using U = uint_n<N>;
+  const uint8_t *base = ptr<const uint8_t>(COIL_OP(1));
+  uint32_t on = active(st, ip, ip->n);
+  for (uint32_t i = 0; i < ip->n; i++) {
+    bool live = i < on && (!(ip->mode & MODE_MASK) || lane_on<U>(COIL_OP(3), i));
+    U v = live ? get<U>(base + static_cast<i64>(get<I>(COIL_OP(2) + i * sizeof(I))) * N) : U(0);
+    put<U>(COIL_OP(0) + i * N, v);
+  }
+}
+
+// a[0] base, a[1] index vector, a[2] source, a[3] mask with MODE_MASK
+template <int N, class I>
+inline void h_vscatter(state &st, const record *ip) {
+  using U = uint_n<N>;
+  uint8_t *base = ptr<uint8_t>(COIL_OP(0));
+  uint32_t on = active(st, ip, ip->n);
+  for (uint32_t i = 0; i < on; i++)
+    if (!(ip->mode & MODE_MASK) || lane_on<U>(COIL_OP(3), i))
+      put<U>(base + static_cast<i64>(get<I>(COIL_OP(1) + i * sizeof(I))) * N, get<U>(COIL_OP(2) + i * N));
+}
+
+template <int N> inline void h_vgather_i8(state &st, const record *ip) { h_vgather<N, i8>(st, ip); }
+template <int N> inline void h_vgather_i16(state &st, const record *ip) { h_vgather<N, i16>(st, ip); }
+template <int N> inline void h_vgather_i32(state &st, const record *ip) { h_vgather<N, i32>(st, ip); }
+template <int N> inline void h_vgather_i64(state &st, const record *ip) { h_vgather<N, i64>(st, ip); }
+template <int N> inline void h_vscatter_i8(state &st, const record *ip) { h_vscatter<N, i8>(st, ip); }
+template <int N> inline void h_vscatter_i16(state &st, const record *ip) { h_vscatter<N, i16>(st, ip); }
+template <int N> inline void h_vscatter_i32(state &st, const record *ip) { h_vscatter<N, i32>(st, ip); }
+template <int N> inline void h_vscatter_i64(state &st, const record *ip) { h_vscatter<N, i64>(st, ip); }
+
+template <int N>
+inline void h_vsplat(state &st, const record *ip) {
+  for (uint32_t i = 0; i < ip->n; i += N) std::memcpy(COIL_OP(0) + i, COIL_OP(1), N);
+}
+
+// a[2] lane number
+template <int N>
+inline void h_vextract(state &st, const record *ip) {
+  std::memcpy(COIL_OP(0), COIL_OP(1) + (get<u64>(COIL_OP(2)) % (ip->n / N)) * N, N);
+}
+
+// a[1] vector, a[2] scalar, a[3] lane number
+template <int N>
+inline void h_vinsert(state &st, const record *ip) {
+  if (ip->a[0] != ip->a[1]) std::memmove(COIL_OP(0), COIL_OP(1), ip->n);
+  std::memcpy(COIL_OP(0) + (get<u64>(COIL_OP(3)) % (ip->n / N)) * N, COIL_OP(2), N);
+}
+
+// a[1] src1, a[2] src2, a[3] indices
+template <int N>
+inline void h_vshuffle(state &st, const record *ip) {
+  using U = uint_n<N>;
+  uint32_t lanes = ip->n / N;
+  uint8_t out[64];
+  for (uint32_t i = 0; i < lanes; i++) {
+    uint32_t k = static_cast<uint32_t>(get<U>(COIL_OP(3) + i * N) % (2 * lanes));
+    std::memcpy(out + i * N, (k < lanes ? COIL_OP(1) : COIL_OP(2)) + (k % lanes) * N, N);
+  }
+  std::memcpy(COIL_OP(0), out, ip->n);
+}
+
+// a[1] source, a[2] indices
+template <int N>
+inline void h_vpermute(state &st, const record *ip) {
+  using U = uint_n<N>;
+  uint32_t lanes = ip->n / N;
+  uint8_t out[64];
+  for (uint32_t i = 0; i < lanes; i++) std::memcpy(out + i * N, COIL_OP(1) + static_cast<uint32_t>(get<U>(COIL_OP(2) + i * N) % lanes) * N, N);
+  std::memcpy(COIL_OP(0), out, ip->n);
+}
+
+// Lane by lane arithmetic computes every lane, lanes past the active length
+// are unspecified so computing them costs nothing but time
+template <class L, class Op>
+inline void lanes2(state &st, const record *ip, Op op) {
+  for (uint32_t i = 0; i < ip->n; i += sizeof(L)) put<L>(COIL_OP(0) + i, op(get<L>(COIL_OP(1) + i), get<L>(COIL_OP(2) + i)));
+}
+
+template <class L>
+inline L wrap_add(L a, L b) {
+  if constexpr (is_fp<L>) return a + b;
+  else return static_cast<L>(static_cast<uns<L>>(a) + static_cast<uns<L>>(b));
+}
+
+template <class L>
+inline L wrap_mul(L a, L b) {
+  if constexpr (is_fp<L>) return a * b;
+  else {
+    using W = std::conditional_t<(sizeof(L) < sizeof(unsigned)), unsigned, uns<L>>;
+    return static_cast<L>(static_cast<W>(static_cast<uns<L>>(a)) * static_cast<W>(static_cast<uns<L>>(b)));
+  }
+}
+
+template <class L>
+inline void h_vadd(state &st, const record *ip) { lanes2<L>(st, ip, [](L a, L b) { return wrap_add(a, b); }); }
+template <class L>
+inline void h_vsub(state &st, const record *ip) {
+  lanes2<L>(st, ip, [](L a, L b) {
+    if constexpr (is_fp<L>) return a - b;
+    else return static_cast<L>(static_cast<uns<L>>(a) - static_cast<uns<L>>(b));
+  });
+}
+template <class L>
+inline void h_vmul(state &st, const record *ip) { lanes2<L>(st, ip, [](L a, L b) { return wrap_mul(a, b); }); }
+template <class L>
+inline void h_vdiv(state &st, const record *ip) { lanes2<L>(st, ip, [](L a, L b) { return static_cast<L>(a / b); }); }
+template <class L>
+inline void h_vmin(state &st, const record *ip) {
+  lanes2<L>(st, ip, [](L a, L b) {
+    if constexpr (is_fp<L>) return std::fmin(a, b);
+    else return b < a ? b : a;
+  });
+}
+template <class L>
+inline void h_vmax(state &st, const record *ip) {
+  lanes2<L>(st, ip, [](L a, L b) {
+    if constexpr (is_fp<L>) return std::fmax(a, b);
+    else return a < b ? b : a;
+  });
+}
+template <class L>
+inline void h_vaddsat(state &st, const record *ip) { lanes2<L>(st, ip, [](L a, L b) { return add_sat(a, b); }); }
+template <class L>
+inline void h_vsubsat(state &st, const record *ip) { lanes2<L>(st, ip, [](L a, L b) { return sub_sat(a, b); }); }
+
+inline void h_vand(state &st, const record *ip) { lanes2<u64>(st, ip, [](u64 a, u64 b) { return a & b; }); }
+inline void h_vor(state &st, const record *ip) { lanes2<u64>(st, ip, [](u64 a, u64 b) { return a | b; }); }
+inline void h_vxor(state &st, const record *ip) { lanes2<u64>(st, ip, [](u64 a, u64 b) { return a ^ b; }); }
+
+// a[1] mask, a[2] src1, a[3] src2, a bitwise blend since mask lanes are all
+// set or all clear
+inline void h_vselect(state &st, const record *ip) {
+  for (uint32_t i = 0; i < ip->n; i += 8) {
+    u64 m = get<u64>(COIL_OP(1) + i);
+    put<u64>(COIL_OP(0) + i, (get<u64>(COIL_OP(2) + i) & m) | (get<u64>(COIL_OP(3) + i) & ~m));
+  }
+}
+
+// a[2] a scalar count, or a count vector with MODE_VCOUNT
+template <class L>
+inline void h_vshl(state &st, const record *ip) {
+  for (uint32_t i = 0; i < ip->n; i += sizeof(L)) {
+    u64 c = ip->mode & MODE_VCOUNT ? static_cast<u64>(get<uns<L>>(COIL_OP(2) + i)) : get<u64>(COIL_OP(2));
+    put<L>(COIL_OP(0) + i, c >= bits<L> ? L(0) : shift_left(get<L>(COIL_OP(1) + i), static_cast<uns<L>>(c)));
+  }
+}
+
+template <class L>
+inline void h_vshr(state &st, const record *ip) {
+  for (uint32_t i = 0; i < ip->n; i += sizeof(L)) {
+    u64 c = ip->mode & MODE_VCOUNT ? static_cast<u64>(get<uns<L>>(COIL_OP(2) + i)) : get<u64>(COIL_OP(2));
+    put<L>(COIL_OP(0) + i, shift_right(get<L>(COIL_OP(1) + i), static_cast<uns<L>>(std::min<u64>(c, bits<L>))));
+  }
+}
+
+template <class L>
+inline void h_vfma(state &st, const record *ip) {
+  for (uint32_t i = 0; i < ip->n; i += sizeof(L))
+    put<L>(COIL_OP(0) + i, std::fma(get<L>(COIL_OP(1) + i), get<L>(COIL_OP(2) + i), get<L>(COIL_OP(3) + i)));
+}
+
+// a[1] src1, a[2] src2, aux BRANCH_COND_EQ to BRANCH_COND_LE
+template <class L>
+inline void h_vcmp(state &st, const record *ip) {
+  for (uint32_t i = 0; i < ip->n; i += sizeof(L)) {
+    L a = get<L>(COIL_OP(1) + i), b = get<L>(COIL_OP(2) + i);
+    uint8_t rel = a < b ? FL_LT : a == b ? FL_EQ : a > b ? FL_GT : 0;
+    put<uns<L>>(COIL_OP(0) + i, cond_table[ip->aux][rel] ? static_cast<uns<L>>(~uns<L>(0)) : uns<L>(0));
+  }
+}
+
+// a[1] source, a[2] mask with MODE_MASK, aux REDUCE. Lanes are combined
+// from the lowest up, which makes REDUCE_ADD the same as REDUCE_ADD_ORD.
+template <class L>
+inline void h_vreduce(state &st, const record *ip) {
+  using U = uns<L>;
+  uint32_t on = active(st, ip, ip->n / sizeof(L));
+  L acc, lowest, highest;
+  if constexpr (is_fp<L>) {
+    lowest = -std::numeric_limits<L>::infinity();
+    highest = std::numeric_limits<L>::infinity();
+  } else {
+    lowest = min_of<L>();
+    highest = max_of<L>();
+  }
+  switch (ip->aux) {
+    case REDUCE_MIN: acc = highest; break;
+    case REDUCE_MAX: acc = lowest; break;
+    case REDUCE_AND: acc = std::bit_cast<L>(static_cast<U>(~U(0))); break;
+    default: acc = std::bit_cast<L>(U(0)); break;
+  }
+  for (uint32_t i = 0; i < on; i++) {
+    if ((ip->mode & MODE_MASK) && !lane_on<L>(COIL_OP(2), i)) continue;
+    L v = get<L>(COIL_OP(1) + i * sizeof(L));
+    switch (ip->aux) {
+      case REDUCE_MIN:
+        if constexpr (is_fp<L>) acc = std::fmin(acc, v);
+        else acc = v < acc ? v : acc;
+        break;
+      case REDUCE_MAX:
+        if constexpr (is_fp<L>) acc = std::fmax(acc, v);
+        else acc = acc < v ? v : acc;
+        break;
+      case REDUCE_AND: acc = std::bit_cast<L>(static_cast<U>(std::bit_cast<U>(acc) & std::bit_cast<U>(v))); break;
+      case REDUCE_OR: acc = std::bit_cast<L>(static_cast<U>(std::bit_cast<U>(acc) | std::bit_cast<U>(v))); break;
+      case REDUCE_XOR: acc = std::bit_cast<L>(static_cast<U>(std::bit_cast<U>(acc) ^ std::bit_cast<U>(v))); break;
+      default: acc = wrap_add(acc, v); break;
+    }
+  }
+  put<L>(COIL_OP(0), acc);
+}
+
+// n the lane count, aux ROUND
+template <class D, class S>
+inline void h_vcvt(state &st, const record *ip) {
+  D out[64 / sizeof(D)];
+  uint32_t on = active(st, ip, ip->n);
+  for (uint32_t i = 0; i < on; i++) out[i] = convert<D, S>(get<S>(COIL_OP(1) + i * sizeof(S)), ip->aux, false);
+  std::memcpy(COIL_OP(0), out, on * sizeof(D));
+}
+
+// a[1] count, n the lanes of a TYPE_VS, aux the size of dest
+inline void h_vsetvl(state &st, const record *ip) {
+  st.vl = static_cast<uint32_t>(std::min<u64>(get<u64>(COIL_OP(1)), ip->n));
+  store_u(COIL_OP(0), st.vl, ip->aux);
+}
+
+// a[1] src1, a[2] src2, a[3] src3, n the size of the vectors
+template <class A, class N1, class N2>
+inline void h_dot(state &st, const record *ip) {
+  constexpr uint32_t k = sizeof(A) / sizeof(N1);
+  uint32_t on = active(st, ip, ip->n / sizeof(A));
+  for (uint32_t i = 0; i < on; i++) {
+    A acc = get<A>(COIL_OP(3) + i * sizeof(A));
+    for (uint32_t j = 0; j < k; j++) {
+      auto a = widen(get<N1>(COIL_OP(1) + (i * k + j) * sizeof(N1)));
+      auto b = widen(get<N2>(COIL_OP(2) + (i * k + j) * sizeof(N2)));
+      if constexpr (is_fp<A>) acc += static_cast<A>(a) * static_cast<A>(b);
+      else acc = wrap_add(acc, wrap_mul(static_cast<A>(a), static_cast<A>(b)));
+    }
+    put<A>(COIL_OP(0) + i * sizeof(A), acc);
+  }
+}
+
+// Tiles are held row major and packed, n the size in bytes
+inline void h_tzero(state &st, const record *ip) { std::memset(COIL_OP(0), 0, ip->n); }
+
+// a[0] tile, a[1] pointer, a[2] stride, a[3] row bytes, n rows
+inline void h_tload(state &st, const record *ip) {
+  const uint8_t *p = ptr<const uint8_t>(COIL_OP(1));
+  i64 stride = get<i64>(COIL_OP(2));
+  for (uint32_t r = 0; r < ip->n; r++) std::memcpy(COIL_OP(0) + r * ip->a[3], p + static_cast<i64>(r) * stride, ip->a[3]);
+}
+
+// a[0] pointer, a[1] tile
+inline void h_tstore(state &st, const record *ip) {
+  uint8_t *p = ptr<uint8_t>(COIL_OP(0));
+  i64 stride = get<i64>(COIL_OP(2));
+  for (uint32_t r = 0; r < ip->n; r++) std::memcpy(p + static_cast<i64>(r) * stride, COIL_OP(1) + r * ip->a[3], ip->a[3]);
+}
+
+// a[0] acc, a[1] src1, a[2] src2, then M, K and N themselves
+template <class A, class S1, class S2>
+inline void h_tmma(state &st, const record *ip) {
+  uint32_t m = ip->a[3], k = ip->a[4], n = ip->a[5];
+  for (uint32_t i = 0; i < m; i++)
+    for (uint32_t j = 0; j < n; j++) {
+      A acc = get<A>(COIL_OP(0) + (i * n + j) * sizeof(A));
+      for (uint32_t l = 0; l < k; l++) {
+        auto a = widen(get<S1>(COIL_OP(1) + (i * k + l) * sizeof(S1)));
+        auto b = widen(get<S2>(COIL_OP(2) + (l * n + j) * sizeof(S2)));
+        if constexpr (is_fp<A>) acc += static_cast<A>(a) * static_cast<A>(b);
+        else acc = wrap_add(acc, wrap_mul(static_cast<A>(a), static_cast<A>(b)));
+      }
+      put<A>(COIL_OP(0) + (i * n + j) * sizeof(A), acc);
+    }
+}
+
+}  // namespace coil::detail
+
+#endif
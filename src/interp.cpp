@@ -0,0 +1,200 @@
+// The dispatch loop of the engine. With GCC and Clang every handler ends in
+// its own indirect jump to the next (isa/cf.md, Threaded Dispatch), other
+// compilers and COIL_SWITCH_DISPATCH builds use one switch.
+
+#include "handlers.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace coil::detail {
+
+thread_stack &this_thread_stack() {
+  static thread_local thread_stack stack;
+  return stack;
+}
+
+namespace {
+
+// The callee of a call site, decoding it on its first call
+const decoded &callee(const call_site &site, const uint8_t *f) {
+  function *fn = site.target ? site.target : get<function *>(f + site.slot);
+  if (!fn) throw error("engine: call through a null function pointer");
+  return fn->code();
+}
+
+// With fn null writes the label table to *labels and returns
+void run(const decoded *fn, uint8_t *f, uint8_t *rf, const uint32_t *ro, uint32_t nr, const void *const **labels) {
+#if COIL_THREADED
+  static const void *const table[] = {
+#define COIL_ADDRESS(name, ...) &&L_##name,
+      COIL_STRAIGHT(COIL_ADDRESS) COIL_BRANCHES(COIL_ADDRESS) COIL_CONTROL(COIL_ADDRESS)
+#undef COIL_ADDRESS
+  };
+  static_assert(sizeof table / sizeof table[0] == H_COUNT);
+  if (!fn) {
+    *labels = table;
+    return;
+  }
+#define COIL_LABEL(name) L_##name:
+#define COIL_NEXT() goto *ip->handler
+#else
+  if (!fn) {
+    *labels = nullptr;
+    return;
+  }
+#define COIL_LABEL(name) case H_##name:
+#define COIL_NEXT() continue
+#endif
+
+  thread_stack &stack = this_thread_stack();
+  state st{f, fn->code.data(), &stack, UINT32_MAX, 0};
+  const record *ip = st.code;
+
+#if COIL_THREADED
+  COIL_NEXT();
+#else
+  for (;;) switch (static_cast<handler>(ip->op)) {
+#endif
+
+#define COIL_STEP(name, fn) \
+  COIL_LABEL(name)          \
+  fn(st, ip);               \
+  ++ip;                     \
+  COIL_NEXT();
+  COIL_STRAIGHT(COIL_STEP)
+#undef COIL_STEP
+
+  // A CMP followed by its BR, the BR record after it is skipped
+#define COIL_STEP(name, fn)                                                      \
+  COIL_LABEL(name)                                                               \
+  fn(st, ip);                                                                    \
+  ip = cond_table[ip->aux][st.flags] ? st.code + ip->a[2] : ip + 2;              \
+  COIL_NEXT();
+  COIL_BRANCHES(COIL_STEP)
+#undef COIL_STEP
+
+  // a[0] target
+  COIL_LABEL(BR)
+  ip = st.code + ip->a[0];
+  COIL_NEXT();
+
+  // a[0] target, aux BRANCH_COND
+  COIL_LABEL(BR_COND)
+  ip = cond_table[ip->aux][st.flags] ? st.code + ip->a[0] : ip + 1;
+  COIL_NEXT();
+
+  // a[0] the address written by BADDR
+  COIL_LABEL(BRI)
+  ip = get<const record *>(COIL_OP(0));
+  COIL_NEXT();
+
+  // a[0] index, a[1] low, a[2] default then the n targets in extra
+#define COIL_SWITCH(bytes)                                                        \
+  COIL_LABEL(SWITCH_##bytes) {                                                    \
+    using U = uint_n<bytes>;                                                      \
+    U d = static_cast<U>(get<U>(COIL_OP(0)) - get<U>(COIL_OP(1)));               \
+    ip = st.code + fn->extra[ip->a[2] + (d < ip->n ? d + 1 : 0)];                 \
+  }                                                                               \
+  COIL_NEXT();
+  COIL_SWITCH(1)
+  COIL_SWITCH(2)
+  COIL_SWITCH(4)
+  COIL_SWITCH(8)
+#undef COIL_SWITCH
+
+  // a[0] value, a[1] first of the n cases, a[2] default, aux the size of
+  // value and mode set when it is signed. Keys are ordered as unsigned, a
+  // signed value has its sign bit flipped.
+  COIL_LABEL(SWITCHS) {
+    u64 key = static_cast<u64>(load_u(COIL_OP(0), ip->aux));
+    if (ip->mode) {
+      unsigned shift = 64 - 8 * ip->aux;
+      key = static_cast<u64>(static_cast<i64>(key << shift) >> shift) ^ (u64{1} << 63);
+    }
+    auto first = fn->cases.begin() + ip->a[1], last = first + ip->n;
+    auto it = std::lower_bound(first, last, key, [](const auto &c, u64 k) { return c.first < k; });
+    ip = st.code + (it != last && it->first == key ? it->second : ip->a[2]);
+  }
+  COIL_NEXT();
+
+  // a[0] call site
+  COIL_LABEL(CALL) {
+    const call_site &site = fn->calls[ip->a[0]];
+    const decoded &cd = callee(site, st.f);
+    uint8_t *top = stack.top;
+    uint8_t *nf = stack.alloc(cd.frame_size);
+    init_frame(cd, nf);
+    size_t n = std::min<size_t>(site.nargs, cd.params.size());
+    for (size_t i = 0; i < n; i++) std::memcpy(nf + cd.params[i].first, st.f + fn->extra[site.args + i], cd.params[i].second);
+    try {
+      run(&cd, nf, st.f, fn->extra.data() + site.rets, site.nrets, nullptr);
+    } catch (...) {
+      stack.top = top;
+      throw;
+    }
+    stack.top = top;
+    ++ip;
+  }
+  COIL_NEXT();
+
+  // a[0] call site. The arguments are staged outside the frame, which the
+  // callee then takes over.
+  COIL_LABEL(TAIL) {
+    const call_site &site = fn->calls[ip->a[0]];
+    const decoded &cd = callee(site, st.f);
+    size_t n = std::min<size_t>(site.nargs, cd.params.size()), bytes = 0;
+    for (size_t i = 0; i < n; i++) bytes += cd.params[i].second;
+    if (stack.scratch.size() < bytes) stack.scratch.resize(bytes);
+    bytes = 0;
+    for (size_t i = 0; i < n; i++) {
+      std::memcpy(stack.scratch.data() + bytes, st.f + fn->extra[site.args + i], cd.params[i].second);
+      bytes += cd.params[i].second;
+    }
+    stack.top = st.f;
+    stack.alloc(cd.frame_size);
+    fn = &cd;
+    init_frame(cd, st.f);
+    bytes = 0;
+    for (size_t i = 0; i < n; i++) {
+      std::memcpy(st.f + cd.params[i].first, stack.scratch.data() + bytes, cd.params[i].second);
+      bytes += cd.params[i].second;
+    }
+    st.code = cd.code.data();
+    st.vl = UINT32_MAX;
+    ip = st.code;
+  }
+  COIL_NEXT();
+
+  // a[0] first of the n values in extra, each an offset and a size
+  COIL_LABEL(RET) {
+    uint32_t n = std::min(ip->n, nr);
+    for (uint32_t i = 0; i < n; i++) {
+      const uint32_t *v = fn->extra.data() + ip->a[0] + 2 * i;
+      std::memcpy(rf + ro[i], st.f + v[0], v[1]);
+    }
+    return;
+  }
+
+#if !COIL_THREADED
+    case H_COUNT: break;
+  }
+#endif
+#undef COIL_LABEL
+#undef COIL_NEXT
+}
+
+}  // namespace
+
+void execute(const decoded &fn, uint8_t *f, uint8_t *rf, const uint32_t *ro, uint32_t nr) { run(&fn, f, rf, ro, nr, nullptr); }
+
+const void *const *handler_labels() {
+  static const void *const *labels = [] {
+    const void *const *l = nullptr;
+    run(nullptr, nullptr, nullptr, nullptr, 0, &l);
+    return l;
+  }();
+  return labels;
+}
+
+}  // namespace coil::detail
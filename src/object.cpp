@@ -0,0 +1,258 @@
+#include <coil/object.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace coil {
+
+namespace {
+
+bool fits(uint64_t offset, uint64_t size, uint64_t limit) { return offset <= limit && size <= limit - offset; }
+
+// The symbol hash table, obj.md
+struct hash_view {
+  const uint32_t *words;
+  uint32_t buckets;
+  uint32_t count;
+
+  uint32_t bucket(uint32_t i) const { return words[2 + i]; }
+  uint32_t chain(uint32_t i) const { return words[2 + buckets + i]; }
+  uint32_t hash(uint32_t i) const { return words[2 + buckets + count + i]; }
+};
+
+}  // namespace
+
+object::object(std::vector<uint8_t> bytes) : bytes_(std::move(bytes)) {
+  uint64_t file = bytes_.size();
+  if (file < sizeof(object_header)) throw error("object: file is smaller than the header");
+  const object_header &h = header();
+  if (std::memcmp(h.magic, object_magic, 4) != 0) throw error("object: bad magic");
+  if (h.major != 1) throw error("object: unknown major version " + std::to_string(h.major));
+  if (h.file_size != file) throw error("object: file size does not match the header");
+  if (h.section_count == 0) throw error("object: no null section");
+  if (h.directory % 8 != 0 || !fits(h.directory, uint64_t{h.section_count} * sizeof(section_header), file))
+    throw error("object: section directory is misaligned or outside the file");
+
+  const section_header &null = section(0);
+  static constexpr section_header zero{};
+  if (std::memcmp(&null, &zero, sizeof zero) != 0) throw error("object: section 0 is not the null section");
+
+  for (uint32_t i = 1; i < h.section_count; i++) {
+    const section_header &s = section(i);
+    if (s.align < 3 || s.align > 63) throw error("object: section " + std::to_string(i) + " has an alignment below 8 bytes");
+    if (s.type == SECT_BSS) continue;
+    if (s.offset % (uint64_t{1} << s.align) != 0 || !fits(s.offset, s.size, file))
+      throw error("object: section " + std::to_string(i) + " is misaligned or outside the file");
+  }
+
+  if (h.strtab == 0 || h.strtab >= h.section_count || section(h.strtab).type != SECT_STRTAB)
+    throw error("object: no string table");
+  std::span<const uint8_t> strtab = contents(h.strtab);
+  if (strtab.empty() || strtab.front() != 0 || strtab.back() != 0) throw error("object: string table does not start and end with NUL");
+
+  if (h.symtab != 0) {
+    if (h.symtab >= h.section_count || section(h.symtab).type != SECT_SYMTAB || section(h.symtab).size % sizeof(symbol_entry) != 0)
+      throw error("object: bad symbol table");
+    symbols_ = static_cast<uint32_t>(section(h.symtab).size / sizeof(symbol_entry));
+    if (symbols_ == 0) throw error("object: symbol table has no null symbol");
+
+    for (uint32_t i = 1; i < h.section_count; i++) {
+      const section_header &s = section(i);
+      if (s.type != SECT_SYMHASH || s.link != h.symtab) continue;
+      if (s.size < 8) throw error("object: bad symbol hash table");
+      const uint32_t *w = &at<uint32_t>(s.offset);
+      uint64_t need = 8 + 4 * (uint64_t{w[0]} + 2 * uint64_t{w[1]});
+      if (w[0] == 0 || (w[0] & (w[0] - 1)) != 0 || w[1] != symbols_ || s.size < need)
+        throw error("object: bad symbol hash table");
+      symhash_ = i;
+    }
+  }
+}
+
+object object::read_file(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) throw error("object: can not open " + path);
+  std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  return object(std::move(bytes));
+}
+
+const section_header &object::section(uint32_t index) const {
+  if (index >= header().section_count) throw error("object: section index " + std::to_string(index) + " out of range");
+  return at<section_header>(header().directory + uint64_t{index} * sizeof(section_header));
+}
+
+std::span<const uint8_t> object::contents(uint32_t index) const {
+  const section_header &s = section(index);
+  if (s.type == SECT_BSS || s.type == SECT_NULL) return {};
+  return {bytes_.data() + s.offset, s.size};
+}
+
+const symbol_entry &object::symbol(uint32_t index) const {
+  if (index >= symbols_) throw error("object: symbol index " + std::to_string(index) + " out of range");
+  return at<symbol_entry>(section(header().symtab).offset + uint64_t{index} * sizeof(symbol_entry));
+}
+
+std::string_view object::string(uint32_t offset) const {
+  std::span<const uint8_t> strtab = contents(header().strtab);
+  if (offset >= strtab.size()) throw error("object: string offset out of range");
+  // The table ends with NUL, so every string in it is terminated
+  return reinterpret_cast<const char *>(strtab.data() + offset);
+}
+
+uint32_t object::find(std::string_view name) const {
+  if (symbols_ == 0) return 0;
+  uint32_t h = coil_hash(name);
+  if (symhash_ != 0) {
+    hash_view table{&at<uint32_t>(section(symhash_).offset), at<uint32_t>(section(symhash_).offset), symbols_};
+    for (uint32_t i = table.bucket(h & (table.buckets - 1)); i != 0 && i < symbols_; i = table.chain(i))
+      if (table.hash(i) == h && symbol(i).bind != SYM_BIND_LOCAL && symbol_name(i) == name) return i;
+    return 0;
+  }
+  for (uint32_t i = 1; i < symbols_; i++)
+    if (symbol(i).bind != SYM_BIND_LOCAL && symbol_name(i) == name) return i;
+  return 0;
+}
+
+object_writer::object_writer() {
+  sections_.emplace_back();
+  symbols_.emplace_back();
+  strings_.push_back(0);
+}
+
+uint32_t object_writer::add_string(std::string_view s) {
+  if (s.empty()) return 0;
+  uint32_t offset = static_cast<uint32_t>(strings_.size());
+  strings_.insert(strings_.end(), s.begin(), s.end());
+  strings_.push_back(0);
+  return offset;
+}
+
+uint32_t object_writer::add_section(std::string_view name, uint16_t type, uint8_t align, uint32_t flags) {
+  pending p;
+  p.header.name = add_string(name);
+  p.header.type = type;
+  p.header.align = align < 3 ? 3 : align;
+  p.header.flags = flags;
+  sections_.push_back(std::move(p));
+  return static_cast<uint32_t>(sections_.size() - 1);
+}
+
+uint32_t object_writer::add_symbol(std::string_view name, uint8_t kind, uint8_t bind, uint32_t section, uint64_t value, uint64_t size) {
+  symbol_entry e{};
+  e.name = add_string(name);
+  e.kind = kind;
+  e.bind = bind;
+  e.section = section;
+  e.value = value;
+  e.size = size;
+  symbols_.push_back(e);
+  return static_cast<uint32_t>(symbols_.size() - 1);
+}
+
+void object_writer::add_reloc(uint32_t section, uint64_t offset, uint32_t symbol, uint16_t type, int64_t addend) {
+  relocs_.push_back({section, reloc_entry{offset, symbol, type, 0, addend}});
+}
+
+std::vector<uint8_t> object_writer::finish() {
+  for (size_t i = 2; i < symbols_.size(); i++)
+    if (symbols_[i].bind == SYM_BIND_LOCAL && symbols_[i - 1].bind != SYM_BIND_LOCAL)
+      throw error("object: local symbol after a global symbol");
+
+  auto append = [](std::vector<uint8_t> &to, const void *p, size_t n) {
+    const uint8_t *b = static_cast<const uint8_t *>(p);
+    to.insert(to.end(), b, b + n);
+  };
+
+  // One relocation section per relocated section, in section order
+  std::vector<pending> extra;
+  for (uint32_t target = 1; target < sections_.size(); target++) {
+    pending r;
+    for (const auto &[s, e] : relocs_)
+      if (s == target) append(r.data, &e, sizeof e);
+    if (r.data.empty()) continue;
+    r.header.type = SECT_RELOC;
+    r.header.align = 3;
+    r.header.link = target;
+    extra.push_back(std::move(r));
+  }
+
+  uint32_t symtab = static_cast<uint32_t>(sections_.size() + extra.size());
+  pending syms;
+  syms.header.name = add_string(".symtab");
+  syms.header.type = SECT_SYMTAB;
+  syms.header.align = 3;
+  append(syms.data, symbols_.data(), symbols_.size() * sizeof(symbol_entry));
+
+  // Hash table over every global and weak symbol
+  pending hash;
+  hash.header.name = add_string(".symhash");
+  hash.header.type = SECT_SYMHASH;
+  hash.header.align = 3;
+  hash.header.link = symtab;
+  {
+    uint32_t count = static_cast<uint32_t>(symbols_.size()), buckets = 1;
+    while (buckets < count) buckets <<= 1;
+    std::vector<uint32_t> words(2 + buckets + 2 * count, 0);
+    words[0] = buckets;
+    words[1] = count;
+    for (uint32_t i = count; i-- > 1;) {
+      if (symbols_[i].bind == SYM_BIND_LOCAL) continue;
+      const char *name = reinterpret_cast<const char *>(strings_.data() + symbols_[i].name);
+      uint32_t h = coil_hash(name);
+      uint32_t &head = words[2 + (h & (buckets - 1))];
+      words[2 + buckets + i] = head;
+      words[2 + buckets + count + i] = h;
+      head = i;
+    }
+    append(hash.data, words.data(), words.size() * 4);
+  }
+
+  pending strtab;
+  strtab.header.name = add_string(".strtab");
+  strtab.header.type = SECT_STRTAB;
+  strtab.header.align = 3;
+  strtab.data = strings_;
+
+  std::vector<pending *> all;
+  for (pending &p : sections_) all.push_back(&p);
+  for (pending &p : extra) all.push_back(&p);
+  all.push_back(&syms);
+  all.push_back(&hash);
+  all.push_back(&strtab);
+
+  object_header h{};
+  std::memcpy(h.magic, object_magic, 4);
+  h.major = 1;
+  h.section_count = static_cast<uint32_t>(all.size());
+  h.directory = sizeof(object_header);
+  h.symtab = symtab;
+  h.strtab = static_cast<uint32_t>(all.size() - 1);
+
+  uint64_t offset = h.directory + uint64_t{h.section_count} * sizeof(section_header);
+  for (size_t i = 1; i < all.size(); i++) {
+    section_header &s = all[i]->header;
+    if (s.type == SECT_BSS) {
+      s.offset = 0;
+      s.size = all[i]->bss_size;
+      continue;
+    }
+    uint64_t align = uint64_t{1} << s.align;
+    offset = (offset + align - 1) & ~(align - 1);
+    s.offset = offset;
+    s.size = all[i]->data.size();
+    offset += s.size;
+  }
+  h.file_size = offset;
+
+  std::vector<uint8_t> out(offset, 0);
+  std::memcpy(out.data(), &h, sizeof h);
+  for (size_t i = 0; i < all.size(); i++) {
+    std::memcpy(out.data() + h.directory + i * sizeof(section_header), &all[i]->header, sizeof(section_header));
+    if (all[i]->header.type != SECT_BSS && !all[i]->data.empty())
+      std::memcpy(out.data() + all[i]->header.offset, all[i]->data.data(), all[i]->data.size());
+  }
+  return out;
+}
+
+}  // namespace coil
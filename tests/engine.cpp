@@ -0,0 +1,267 @@
+// Runs small functions through the engine, built with object_writer and
+// code_writer, and checks their results
+
+#include <coil/code.hpp>
+#include <coil/engine.hpp>
+#include <coil/isa.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace coil;
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(e)                                                   \
+  do {                                                             \
+    if (!(e)) {                                                    \
+      std::fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #e); \
+      failures++;                                                  \
+    }                                                              \
+  } while (0)
+
+// An object with one code section. Labels are local symbols and have to be
+// declared before the first function.
+struct builder {
+  object_writer w;
+  uint32_t data = w.add_section(".data", SECT_DATA, 3, SECT_FLAG_WRITE);
+  uint32_t text = w.add_section(".text", SECT_CODE);
+  code_writer c{w.data(text)};
+  uint32_t current = 0;
+
+  uint32_t label(const std::string &name) { return w.add_symbol(name, SYM_KIND_NONE, SYM_BIND_LOCAL, text); }
+  void place(uint32_t label) { w.symbol(label).value = c.offset(); }
+
+  void begin(const std::string &name) { current = w.add_symbol(name, SYM_KIND_FUNC, SYM_BIND_GLOBAL, text, c.offset()); }
+  void end() { w.symbol(current).size = c.offset() - w.symbol(current).value; }
+
+  uint32_t variable(const std::string &name, uint64_t value) {
+    std::vector<uint8_t> &d = w.data(data);
+    uint32_t s = w.add_symbol(name, SYM_KIND_DATA, SYM_BIND_GLOBAL, data, d.size(), 8);
+    d.resize(d.size() + 8);
+    std::memcpy(d.data() + d.size() - 8, &value, 8);
+    return s;
+  }
+
+  object finish() { return object(w.finish()); }
+};
+
+uint64_t call(engine &e, const char *name, std::vector<uint64_t> args) {
+  uint64_t r = 0;
+  function *fn = e.find(name);
+  if (!fn) throw error(std::string("no function ") + name);
+  e.call(*fn, args, {&r, 1});
+  return r;
+}
+
+// sum(n) = 0 + 1 + ... + n - 1, a CMP merged with its BR
+void loop_sum() {
+  builder b;
+  uint32_t loop = b.label("loop"), done = b.label("done");
+  b.begin("sum");
+  b.c.insn(ENTER, {var(0, TYPE_UNT64)});
+  b.c.insn(MOV, {var(1, TYPE_UNT64), imm(TYPE_UNT64, 0)});
+  b.c.insn(MOV, {var(2, TYPE_UNT64), imm(TYPE_UNT64, 0)});
+  b.place(loop);
+  b.c.insn(CMP, {var(2, TYPE_UNT64), var(0, TYPE_UNT64)});
+  b.c.insn(BR, {sym(done), param(BRANCH_COND_GE)});
+  b.c.insn(ADD, {var(1, TYPE_UNT64), var(1, TYPE_UNT64), var(2, TYPE_UNT64)});
+  b.c.insn(ADD, {var(2, TYPE_UNT64), var(2, TYPE_UNT64), imm(TYPE_UNT64, 1)});
+  b.c.insn(BR, {sym(loop)});
+  b.place(done);
+  b.c.insn(RET, {var(1, TYPE_UNT64)});
+  b.end();
+
+  engine e;
+  e.load(b.finish());
+  CHECK(call(e, "sum", {10}) == 45);
+  CHECK(call(e, "sum", {0}) == 0);
+  CHECK(call(e, "sum", {100000}) == 4999950000);
+}
+
+// A call, and a tail call deep enough to overflow the stack if it grew it
+void calls() {
+  builder b;
+  uint32_t recurse = b.label("recurse");
+  uint32_t twice = b.w.add_symbol("twice", SYM_KIND_FUNC, SYM_BIND_GLOBAL, b.text);
+  b.current = twice;
+  b.w.symbol(twice).value = b.c.offset();
+  b.c.insn(ENTER, {var(0, TYPE_INT32)});
+  b.c.insn(MUL, {var(1, TYPE_INT32), var(0, TYPE_INT32), imm(TYPE_INT32, 2)});
+  b.c.insn(RET, {var(1, TYPE_INT32)});
+  b.end();
+
+  b.begin("twice_plus_one");
+  b.c.insn(ENTER, {var(0, TYPE_INT32)});
+  b.c.insn(CALL, {sym(twice), param(BRANCH_CTRL_ABI_PARAM), var(0, TYPE_INT32), param(BRANCH_CTRL_ABI_RET), var(1, TYPE_INT32)});
+  b.c.insn(ADD, {var(1, TYPE_INT32), var(1, TYPE_INT32), imm(TYPE_INT32, 1)});
+  b.c.insn(RET, {var(1, TYPE_INT32)});
+  b.end();
+
+  // count(n, acc) = n == 0 ? acc : count(n - 1, acc + n)
+  b.begin("count");
+  uint32_t count = b.current;
+  b.c.insn(ENTER, {var(0, TYPE_UNT64), var(1, TYPE_UNT64)});
+  b.c.insn(CMP, {var(0, TYPE_UNT64), imm(TYPE_UNT64, 0)});
+  b.c.insn(BR, {sym(recurse), param(BRANCH_COND_NE)});
+  b.c.insn(RET, {var(1, TYPE_UNT64)});
+  b.place(recurse);
+  b.c.insn(ADD, {var(1, TYPE_UNT64), var(1, TYPE_UNT64), var(0, TYPE_UNT64)});
+  b.c.insn(SUB, {var(0, TYPE_UNT64), var(0, TYPE_UNT64), imm(TYPE_UNT64, 1)});
+  b.c.insn(CALL, {sym(count), param(BRANCH_CTRL_TAIL), param(BRANCH_CTRL_ABI_PARAM), var(0, TYPE_UNT64), var(1, TYPE_UNT64)});
+  b.end();
+
+  engine e;
+  e.load(b.finish());
+  CHECK(call(e, "twice_plus_one", {20}) == 41);
+  CHECK(static_cast<int32_t>(call(e, "twice_plus_one", {static_cast<uint32_t>(-3)})) == -5);
+  CHECK(call(e, "count", {10000000, 0}) == 50000005000000);
+}
+
+// A table SWITCH and a sparse SWITCHS with negative cases
+void switches() {
+  builder b;
+  uint32_t t0 = b.label("t0"), t1 = b.label("t1"), t2 = b.label("t2"), other = b.label("other");
+  uint32_t neg = b.label("neg"), pos = b.label("pos"), none = b.label("none");
+  b.begin("table");
+  b.c.insn(ENTER, {var(0, TYPE_UNT32)});
+  b.c.insn(SWITCH, {var(0, TYPE_UNT32), imm(TYPE_UNT32, 3), sym(other), sym(t0), sym(t1), sym(t2)});
+  b.place(t0);
+  b.c.insn(RET, {imm(TYPE_UNT64, 10)});
+  b.place(t1);
+  b.c.insn(RET, {imm(TYPE_UNT64, 11)});
+  b.place(t2);
+  b.c.insn(RET, {imm(TYPE_UNT64, 12)});
+  b.place(other);
+  b.c.insn(RET, {imm(TYPE_UNT64, 99)});
+  b.end();
+
+  b.begin("sparse");
+  b.c.insn(ENTER, {var(0, TYPE_INT32)});
+  b.c.insn(SWITCHS, {var(0, TYPE_INT32), sym(none), imm(TYPE_INT32, 7000), sym(pos), imm(TYPE_INT32, -5), sym(neg)});
+  b.place(neg);
+  b.c.insn(RET, {imm(TYPE_UNT64, 1)});
+  b.place(pos);
+  b.c.insn(RET, {imm(TYPE_UNT64, 2)});
+  b.place(none);
+  b.c.insn(RET, {imm(TYPE_UNT64, 0)});
+  b.end();
+
+  engine e;
+  e.load(b.finish());
+  CHECK(call(e, "table", {3}) == 10);
+  CHECK(call(e, "table", {5}) == 12);
+  CHECK(call(e, "table", {6}) == 99);
+  CHECK(call(e, "table", {2}) == 99);
+  CHECK(call(e, "sparse", {static_cast<uint32_t>(-5)}) == 1);
+  CHECK(call(e, "sparse", {7000}) == 2);
+  CHECK(call(e, "sparse", {5}) == 0);
+}
+
+// FETCH, CAS and XCHG on a data symbol, and a memory operand
+void atomics() {
+  builder b;
+  uint32_t counter = b.variable("counter", 5);
+  b.begin("bump");
+  b.c.insn(FETCH, {var(0, TYPE_UNT64), sym(counter), imm(TYPE_UNT64, 3), param(FETCH_OP_ADD), param(MEMORY_ORDER_SEQ_CST)});
+  b.c.insn(CAS, {var(1, TYPE_UNT64), sym(counter), imm(TYPE_UNT64, 8), imm(TYPE_UNT64, 20)});
+  b.c.insn(XCHG, {var(2, TYPE_UNT64), sym(counter), imm(TYPE_UNT64, 1)});
+  b.c.insn(ADD, {sym(counter, TYPE_UNT64), sym(counter, TYPE_UNT64), var(2, TYPE_UNT64)});
+  b.c.insn(ADD, {var(0, TYPE_UNT64), var(0, TYPE_UNT64), var(1, TYPE_UNT64)});
+  b.c.insn(RET, {var(0, TYPE_UNT64)});
+  b.end();
+
+  engine e;
+  e.load(b.finish());
+  CHECK(call(e, "bump", {}) == 5 + 8);
+  uint64_t value;
+  std::memcpy(&value, e.data("counter"), 8);
+  CHECK(value == 21);
+}
+
+// Lanes of a TYPE_V128 added and reduced
+void vectors() {
+  builder b;
+  b.begin("lanes");
+  b.c.insn(ENTER, {var(0, TYPE_INT32)});
+  b.c.insn(VSPLAT, {var(1, TYPE_V128), var(0, TYPE_INT32), type_operand(TYPE_INT32)});
+  b.c.insn(VSPLAT, {var(2, TYPE_V128), imm(TYPE_INT32, 2), type_operand(TYPE_INT32)});
+  b.c.insn(VMUL, {var(1, TYPE_V128), var(1, TYPE_V128), var(2, TYPE_V128), type_operand(TYPE_INT32)});
+  b.c.insn(VINSERT, {var(1, TYPE_V128), var(1, TYPE_V128), imm(TYPE_INT32, 100), imm(TYPE_UNT32, 3), type_operand(TYPE_INT32)});
+  b.c.insn(VREDUCE, {var(3, TYPE_INT32), var(1, TYPE_V128), param(REDUCE_ADD), type_operand(TYPE_INT32)});
+  b.c.insn(RET, {var(3, TYPE_INT32)});
+  b.end();
+
+  engine e;
+  e.load(b.finish());
+  CHECK(call(e, "lanes", {3}) == 3 * 6 + 100);
+}
+
+// CVT rounds toward zero from floating point unless told otherwise
+void conversions() {
+  builder b;
+  b.begin("convert");
+  b.c.insn(ENTER, {var(0, TYPE_FP64)});
+  b.c.insn(CVT, {var(1, TYPE_INT32), var(0, TYPE_FP64)});
+  b.c.insn(CVT, {var(2, TYPE_INT32), var(0, TYPE_FP64), param(ROUND_NEAREST)});
+  b.c.insn(MUL, {var(1, TYPE_INT32), var(1, TYPE_INT32), imm(TYPE_INT32, 10)});
+  b.c.insn(ADD, {var(1, TYPE_INT32), var(1, TYPE_INT32), var(2, TYPE_INT32)});
+  b.c.insn(RET, {var(1, TYPE_INT32)});
+  b.end();
+
+  b.begin("saturate");
+  b.c.insn(ENTER, {var(0, TYPE_INT32)});
+  b.c.insn(CVT, {var(1, TYPE_UNT8), var(0, TYPE_INT32), param(ROUND_NEAREST), param(SAT)});
+  b.c.insn(RET, {var(1, TYPE_UNT8)});
+  b.end();
+
+  engine e;
+  e.load(b.finish());
+  double x = 2.75;
+  uint64_t bits;
+  std::memcpy(&bits, &x, 8);
+  CHECK(call(e, "convert", {bits}) == 23);
+  CHECK(call(e, "saturate", {300}) == 255);
+  CHECK(call(e, "saturate", {static_cast<uint32_t>(-7)}) == 0);
+}
+
+// What the engine does not run is rejected when the function is decoded
+void rejects() {
+  builder b;
+  b.begin("registers");
+  b.c.insn(MOV, {{type_word(TYPE_RGP), {0}}, imm(TYPE_INT64, 1)});
+  b.c.insn(RET, {});
+  b.end();
+
+  engine e;
+  e.load(b.finish());
+  bool thrown = false;
+  try {
+    e.prepare(*e.find("registers"));
+  } catch (const error &) {
+    thrown = true;
+  }
+  CHECK(thrown);
+}
+
+}  // namespace
+
+int main() {
+  try {
+    loop_sum();
+    calls();
+    switches();
+    atomics();
+    vectors();
+    conversions();
+    rejects();
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return failures != 0;
+}
@@ -0,0 +1,16 @@
+// Checks the constants of include/coil against the specification at compile
+// time. Every constant defined at the start of a line in v1 is extracted by
+// cmake/spec_tables.cmake, a constant missing from the headers or with
+// another value fails the build.
+
+#include <coil/isa.hpp>
+#include <coil/object.hpp>
+#include <coil/type.hpp>
+
+using namespace coil;
+
+#define COIL_CONST(name, value) static_assert(name == (value), #name " differs from v1");
+#include "spec.inc"
+#undef COIL_CONST
+
+int main() { return 0; }
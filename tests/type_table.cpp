@@ -0,0 +1,60 @@
+// Checks include/coil/type.hpp against the property table of v1/type.md at
+// compile time. The rows are extracted from the specification by
+// cmake/spec_tables.cmake, any difference fails the build. The constants are
+// checked by tests/spec_constants.cpp.
+
+#include <coil/type.hpp>
+
+#include <cstddef>
+
+using namespace coil;
+
+#define COIL_ROW(t, c, s, a, r)                                                  \
+  static_assert(coil_types[t].category == c && coil_types[t].size == s &&         \
+                    coil_types[t].align == a && coil_types[t].reg_class == r,     \
+                #t " differs from the property table of v1/type.md");
+#include "spec.inc"
+#undef COIL_ROW
+
+namespace {
+
+#define COIL_ROW(t, c, s, a, r) t,
+constexpr uint8_t listed[] = {
+#include "spec.inc"
+};
+#undef COIL_ROW
+
+// Every main type the property table does not list is invalid
+constexpr bool unlisted_are_invalid() {
+  for (int main = 0; main < 256; main++) {
+    bool found = false;
+    for (uint8_t l : listed) found = found || l == main;
+    if (!found && coil_types[main].category != TYPE_CAT_NONE) return false;
+  }
+  return true;
+}
+static_assert(unlisted_are_invalid(), "coil_types has an entry v1/type.md does not list");
+
+// Operand value sizes, v1/overview.md
+static_assert(operand_value_size(type_word(TYPE_PARAM0)) == 1);
+static_assert(operand_value_size(type_word(TYPE_INT32, TYPEEXT_SYM)) == 4);
+static_assert(operand_value_size(type_word(TYPE_INT32, TYPEEXT_VAR)) == 4);
+static_assert(operand_value_size(type_word(TYPE_RGP)) == 1);
+static_assert(operand_value_size(type_word(TYPE_SAF)) == 0);
+static_assert(operand_value_size(type_word(TYPE_UNT16, TYPEEXT_IMM)) == 2);
+static_assert(operand_value_size(type_word(TYPE_BIT, TYPEEXT_IMM)) == 1);
+static_assert(operand_value_size(type_word(TYPE_FP80, TYPEEXT_IMM)) == 16);
+static_assert(operand_value_size(type_word(TYPE_V256, TYPEEXT_IMM)) == 32);
+static_assert(operand_value_size(type_word(TYPE_INT, TYPEEXT_IMM)) == 8);
+static_assert(operand_value_size(type_word(TYPE_PTRU, TYPEEXT_IMM)) == 8);
+static_assert(operand_value_size(type_word(TYPE_FP, TYPEEXT_IMM)) == 8);
+static_assert(operand_value_size(type_word(TYPE_LFP, TYPEEXT_IMM)) == 16);
+static_assert(operand_value_size(type_word(TYPE_CFP, TYPEEXT_IMM)) == 16);
+static_assert(operand_value_size(type_word(TYPE_VS, TYPEEXT_IMM)) == -1);
+static_assert(operand_value_size(type_word(TYPE_TILE, TYPEEXT_IMM)) == -1);
+static_assert(operand_value_size(type_word(TYPE_STRUCT, TYPEEXT_IMM)) == -1);
+static_assert(operand_value_size(type_word(TYPE_INT64)) == 0);
+
+}  // namespace
+
+int main() { return 0; }
@@ -0,0 +1,260 @@
+// coil_as, a text assembler for COIL objects, used for the conformance
+// corpus (v1/conformance.md)
+//
+//   coil_as <source.cas> -o <object.coil>
+//   coil_as --check <source.cas> <object.coil>
+//
+// A source file holds one instruction per line, `;` starts a comment.
+//
+//   .func name        starts a global SYM_KIND_FUNC in .text
+//   .end              ends it
+//   name:             a label, a local symbol at the next instruction
+//   OPCODE op, ...    an instruction, opcodes named as in v1/isa
+//
+// Operands are written
+//
+//   %3:UNT64          variable 3 of TYPE_UNT64
+//   42:INT32 1.5:FP64 immediates, integers in decimal or 0x hexadecimal
+//   @name             the address of a symbol, TYPE_SYM
+//   [@name]:UNT64     the memory at a symbol, TYPEEXT_SYM
+//   #BRANCH_COND_GE   a parameter, named as in v1/isa
+//   FP32              a type operand
+//
+// with type names without their TYPE_ prefix. A symbol that is neither a
+// label nor a function of the file is an undefined global symbol.
+//
+// --check assembles the source and compares it with an existing object, so
+// the objects of the corpus are kept equal to their sources.
+
+#include <coil/code.hpp>
+#include <coil/isa.hpp>
+#include <coil/object.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace coil;
+
+namespace {
+
+const std::map<std::string, uint8_t> &opcodes() {
+  static const std::map<std::string, uint8_t> m = {
+#define COIL_NAME(name, value) {#name, value},
+      COIL_OPCODES(COIL_NAME)
+#undef COIL_NAME
+  };
+  return m;
+}
+
+const std::map<std::string, uint8_t> &params() {
+  static const std::map<std::string, uint8_t> m = {
+#define COIL_NAME(name, value) {#name, value},
+      COIL_PARAMS(COIL_NAME)
+#undef COIL_NAME
+  };
+  return m;
+}
+
+const std::map<std::string, uint8_t> &types() {
+  static const std::map<std::string, uint8_t> m = {
+      {"INT8", TYPE_INT8},     {"INT16", TYPE_INT16},   {"INT32", TYPE_INT32},   {"INT64", TYPE_INT64},
+      {"INT128", TYPE_INT128}, {"UNT8", TYPE_UNT8},     {"UNT16", TYPE_UNT16},   {"UNT32", TYPE_UNT32},
+      {"UNT64", TYPE_UNT64},   {"UNT128", TYPE_UNT128}, {"FP8e5m2", TYPE_FP8e5m2}, {"FP8e4m3", TYPE_FP8e4m3},
+      {"FP16b", TYPE_FP16b},   {"FP16", TYPE_FP16},     {"FP32t", TYPE_FP32t},   {"FP32", TYPE_FP32},
+      {"FP64", TYPE_FP64},     {"FP80", TYPE_FP80},     {"FP128", TYPE_FP128},   {"V128", TYPE_V128},
+      {"V256", TYPE_V256},     {"V512", TYPE_V512},     {"VS", TYPE_VS},         {"TILE", TYPE_TILE},
+      {"BIT", TYPE_BIT},       {"VAR", TYPE_VAR},       {"SYM", TYPE_SYM},       {"INT", TYPE_INT},
+      {"UNT", TYPE_UNT},       {"FP", TYPE_FP},         {"LINT", TYPE_LINT},     {"LUNT", TYPE_LUNT},
+      {"LFP", TYPE_LFP},       {"PTR", TYPE_PTR},       {"PTRD", TYPE_PTRD},     {"PTRS", TYPE_PTRS},
+      {"PTRC", TYPE_PTRC},     {"PTRU", TYPE_PTRU},     {"VOID", TYPE_VOID},
+  };
+  return m;
+}
+
+struct line {
+  int number;
+  std::string label, directive, name, mnemonic;
+  std::vector<std::string> operands;
+};
+
+[[noreturn]] void fail(const std::string &file, int number, const std::string &what) {
+  throw error(file + ":" + std::to_string(number) + ": " + what);
+}
+
+std::string trim(const std::string &s) {
+  size_t b = s.find_first_not_of(" \t\r"), e = s.find_last_not_of(" \t\r");
+  return b == std::string::npos ? "" : s.substr(b, e - b + 1);
+}
+
+std::vector<line> parse(const std::string &file, const std::string &text) {
+  std::vector<line> lines;
+  std::istringstream in(text);
+  std::string raw;
+  for (int number = 1; std::getline(in, raw); number++) {
+    std::string s = trim(raw.substr(0, raw.find(';')));
+    if (s.empty()) continue;
+    line l{number, {}, {}, {}, {}, {}};
+    if (s.back() == ':') {
+      l.label = s.substr(0, s.size() - 1);
+    } else if (s[0] == '.') {
+      std::istringstream words(s);
+      words >> l.directive >> l.name;
+      if (l.directive != ".func" && l.directive != ".end") fail(file, number, "unknown directive " + l.directive);
+      if (l.directive == ".func" && l.name.empty()) fail(file, number, ".func needs a name");
+    } else {
+      size_t space = s.find_first_of(" \t");
+      l.mnemonic = s.substr(0, space);
+      if (space != std::string::npos) {
+        std::istringstream ops(s.substr(space));
+        for (std::string op; std::getline(ops, op, ',');) l.operands.push_back(trim(op));
+      }
+    }
+    lines.push_back(l);
+  }
+  return lines;
+}
+
+class assembler {
+ public:
+  explicit assembler(std::string file) : file_(std::move(file)) {}
+
+  std::vector<uint8_t> run(const std::string &text) {
+    std::vector<line> lines = parse(file_, text);
+    object_writer w;
+    uint32_t text_section = w.add_section(".text", SECT_CODE);
+    w_ = &w;
+
+    // Labels are local and come first, then the functions
+    for (const line &l : lines)
+      if (!l.label.empty()) define(l, w.add_symbol(l.label, SYM_KIND_NONE, SYM_BIND_LOCAL, text_section));
+    for (const line &l : lines)
+      if (l.directive == ".func") define(l, w.add_symbol(l.name, SYM_KIND_FUNC, SYM_BIND_GLOBAL, text_section));
+
+    code_writer c(w.data(text_section));
+    uint32_t current = 0;
+    for (const line &l : lines) {
+      number_ = l.number;
+      if (!l.label.empty()) {
+        w.symbol(symbols_[l.label]).value = c.offset();
+      } else if (l.directive == ".func") {
+        if (current) fail(file_, l.number, ".func inside a function");
+        current = symbols_[l.name];
+        w.symbol(current).value = c.offset();
+      } else if (l.directive == ".end") {
+        if (!current) fail(file_, l.number, ".end outside a function");
+        w.symbol(current).size = c.offset() - w.symbol(current).value;
+        current = 0;
+      } else {
+        if (!current) fail(file_, l.number, "instruction outside a function");
+        auto op = opcodes().find(l.mnemonic);
+        if (op == opcodes().end()) fail(file_, l.number, "unknown opcode " + l.mnemonic);
+        std::vector<operand> operands;
+        for (const std::string &s : l.operands) operands.push_back(parse_operand(s));
+        c.insn(op->second, operands);
+      }
+    }
+    if (current) fail(file_, number_, "function without .end");
+    return w.finish();
+  }
+
+ private:
+  void define(const line &l, uint32_t symbol) {
+    const std::string &name = l.label.empty() ? l.name : l.label;
+    if (!symbols_.emplace(name, symbol).second) fail(file_, l.number, name + " is defined twice");
+  }
+
+  uint8_t type(const std::string &name) const {
+    auto t = types().find(name);
+    if (t == types().end()) fail(file_, number_, "unknown type " + name);
+    return t->second;
+  }
+
+  uint32_t symbol(const std::string &name) {
+    auto it = symbols_.find(name);
+    if (it != symbols_.end()) return it->second;
+    uint32_t s = w_->add_symbol(name, SYM_KIND_NONE, SYM_BIND_GLOBAL);
+    symbols_.emplace(name, s);
+    return s;
+  }
+
+  operand parse_operand(const std::string &s) {
+    if (s.empty()) fail(file_, number_, "empty operand");
+    if (s[0] == '#') {
+      auto p = params().find(s.substr(1));
+      if (p == params().end()) fail(file_, number_, "unknown parameter " + s);
+      return param(p->second);
+    }
+    if (s[0] == '@') return sym(symbol(s.substr(1)));
+    size_t colon = s.rfind(':');
+    if (colon == std::string::npos) return type_operand(type(s));
+    std::string value = s.substr(0, colon);
+    uint8_t main = type(s.substr(colon + 1));
+    if (value.size() > 3 && value.front() == '[' && value[1] == '@' && value.back() == ']')
+      return sym(symbol(value.substr(2, value.size() - 3)), main);
+    if (value[0] == '%') return var(static_cast<uint32_t>(number(value.substr(1))), main);
+    if (main == TYPE_FP32 || main == TYPE_FP64 || main == TYPE_FP) {
+      try {
+        return imm_fp(main, std::stod(value));
+      } catch (const std::exception &) {
+        fail(file_, number_, "bad floating point immediate " + value);
+      }
+    }
+    return imm(main, number(value));
+  }
+
+  int64_t number(const std::string &s) const {
+    try {
+      size_t end = 0;
+      int64_t v = s[0] == '-' ? std::stoll(s, &end, 0) : static_cast<int64_t>(std::stoull(s, &end, 0));
+      if (end == s.size()) return v;
+    } catch (const std::exception &) {
+    }
+    fail(file_, number_, "bad number " + s);
+  }
+
+  std::string file_;
+  object_writer *w_ = nullptr;
+  std::map<std::string, uint32_t> symbols_;
+  int number_ = 0;
+};
+
+std::string read(const std::string &path) {
+  std::ifstream f(path, std::ios::binary);
+  if (!f) throw error("coil_as: can not read " + path);
+  return std::string(std::istreambuf_iterator<char>(f), {});
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> args(argv + 1, argv + argc);
+  try {
+    if (args.size() == 3 && args[0] == "--check") {
+      std::vector<uint8_t> bytes = assembler(args[1]).run(read(args[1]));
+      std::string existing = read(args[2]);
+      if (existing.size() != bytes.size() || !std::equal(bytes.begin(), bytes.end(), existing.begin(),
+                                                         [](uint8_t a, char b) { return a == static_cast<uint8_t>(b); })) {
+        std::fprintf(stderr, "%s is not the object of %s\n", args[2].c_str(), args[1].c_str());
+        return 1;
+      }
+      return 0;
+    }
+    if (args.size() == 3 && args[1] == "-o") {
+      std::vector<uint8_t> bytes = assembler(args[0]).run(read(args[0]));
+      std::ofstream out(args[2], std::ios::binary);
+      out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+      if (!out) throw error("coil_as: can not write " + args[2]);
+      return 0;
+    }
+    std::fprintf(stderr, "usage: coil_as <source.cas> -o <object.coil>\n       coil_as --check <source.cas> <object.coil>\n");
+    return 2;
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+}
@@ -0,0 +1,272 @@
+// coil_bench, runs the conformance corpus on the reference engine and
+// prints a report as described in v1/conformance.md
+//
+//   coil_bench [--quick] <conformance dir>
+//   coil_bench --regenerate <conformance dir>
+//
+// Each test is conformance/<class>/<name>.coil with its .in and .out, the
+// .out being what the reference kernel <name>.c writes for the .in. A test
+// passes when coil_test returns 0 and writes the .out, and when the
+// reference writes it too. Performance is measured for passing tests only.
+//
+// --quick calls each function a few times instead of measuring it, for a
+// check that the corpus still passes. --regenerate writes the .in of each
+// test from its fill and the .out from its reference.
+//
+// The engine runs DIR_PARALLEL serially and every test of the atomic and
+// parallel classes is run on one thread.
+
+#include <coil/engine.hpp>
+#include <coil/object.hpp>
+
+#include <sys/utsname.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifndef COIL_REFERENCE_CC
+#define COIL_REFERENCE_CC "unknown"
+#endif
+
+extern "C" {
+void ref_int_hash(const void *in, void *out);
+void ref_fp_poly(const void *in, void *out);
+void ref_vec_saxpy(const void *in, void *out);
+void ref_atomic_counter(const void *in, void *out);
+void ref_branch_dispatch(const void *in, void *out);
+void ref_mcopy_4k(const void *in, void *out);
+void ref_gemm_f32_16(const void *in, void *out);
+void ref_parallel_sum(const void *in, void *out);
+}
+
+using namespace coil;
+
+namespace {
+
+// How the .in of a test is filled, from a generator seeded by its name
+enum class fill { words, f64, f32, bytes };
+
+struct test {
+  const char *cls;
+  const char *name;
+  size_t in_size, out_size;
+  uint64_t ops;  // per call of coil_test
+  bool latency;  // ops are dependent, reported as latency
+  fill input;
+  void (*reference)(const void *in, void *out);
+};
+
+constexpr test tests[] = {
+    {"int", "int_hash", 8192, 8192, 1024, false, fill::words, ref_int_hash},
+    {"fp", "fp_poly", 8192, 12288, 1024, false, fill::f64, ref_fp_poly},
+    {"vec", "vec_saxpy", 8192, 4096, 1024, false, fill::f32, ref_vec_saxpy},
+    {"atomic", "atomic_counter", 8200, 24, 1024, false, fill::words, ref_atomic_counter},
+    {"branch", "branch_dispatch", 4096, 8, 4096, true, fill::bytes, ref_branch_dispatch},
+    {"mem", "mcopy_4k", 4096, 4352, 4096, false, fill::bytes, ref_mcopy_4k},
+    {"matrix", "gemm_f32_16", 2048, 1024, 4096, false, fill::f32, ref_gemm_f32_16},
+    {"parallel", "parallel_sum", 4096, 8, 1024, false, fill::words, ref_parallel_sum},
+};
+
+using bytes = std::vector<uint8_t>;
+
+bytes read(const std::string &path) {
+  std::ifstream f(path, std::ios::binary);
+  if (!f) throw error("coil_bench: can not read " + path);
+  return bytes(std::istreambuf_iterator<char>(f), {});
+}
+
+void write(const std::string &path, const bytes &b) {
+  std::ofstream f(path, std::ios::binary);
+  f.write(reinterpret_cast<const char *>(b.data()), static_cast<std::streamsize>(b.size()));
+  if (!f) throw error("coil_bench: can not write " + path);
+}
+
+bytes make_input(const test &t) {
+  uint64_t s = coil_hash(t.name) | uint64_t{1} << 32;
+  auto next = [&s] {
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+  };
+  bytes b(t.in_size);
+  for (size_t i = 0; i < b.size();) {
+    uint64_t r = next();
+    // Floating point values are uniform in [-2, 2)
+    if (t.input == fill::f64) {
+      double d = static_cast<double>(r >> 11) * 0x1p-51 - 2;
+      std::memcpy(&b[i], &d, 8);
+      i += 8;
+    } else if (t.input == fill::f32) {
+      float f = static_cast<float>(r >> 40) * 0x1p-22f - 2;
+      std::memcpy(&b[i], &f, 4);
+      i += 4;
+    } else {
+      size_t n = std::min<size_t>(8, b.size() - i);
+      std::memcpy(&b[i], &r, n);
+      i += n;
+    }
+  }
+  return b;
+}
+
+// Nanoseconds per call of run, warming up for 100ms first and then timing
+// at least 30 calls. setup runs before every call and is not timed.
+std::vector<double> measure(const std::function<void()> &setup, const std::function<void()> &run, bool quick) {
+  using clock = std::chrono::steady_clock;
+  auto warm = clock::now() + std::chrono::milliseconds(quick ? 0 : 100);
+  do {
+    setup();
+    run();
+  } while (clock::now() < warm);
+  std::vector<double> ns;
+  for (int i = 0; i < (quick ? 3 : 30); i++) {
+    setup();
+    auto start = clock::now();
+    run();
+    ns.push_back(std::chrono::duration<double, std::nano>(clock::now() - start).count());
+  }
+  std::sort(ns.begin(), ns.end());
+  return ns;
+}
+
+double median(const std::vector<double> &v) { return v[v.size() / 2]; }
+double p99(const std::vector<double> &v) { return v[static_cast<size_t>(std::ceil(0.99 * v.size())) - 1]; }
+
+// 8.21e9, as in the report of v1/conformance.md
+std::string number(double v) {
+  if (!(v > 0) || !std::isfinite(v)) return "-";
+  int e = static_cast<int>(std::floor(std::log10(v)));
+  double m = v / std::pow(10.0, e);
+  if (m >= 9.995) {
+    m /= 10;
+    e++;
+  }
+  char buf[32];
+  std::snprintf(buf, sizeof buf, "%.2fe%d", m, e);
+  return buf;
+}
+
+const char *target() {
+#if defined(__x86_64__) || defined(_M_X64)
+  return "x86-64";
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  return "arm-64";
+#elif defined(__riscv) && __riscv_xlen == 64
+  return "riscv-64";
+#else
+  return "unknown";
+#endif
+}
+
+std::string host_processor() {
+  std::ifstream f("/proc/cpuinfo");
+  for (std::string line; std::getline(f, line);)
+    if (line.rfind("model name", 0) == 0 && line.find(':') != std::string::npos) return line.substr(line.find(':') + 2);
+  return "unknown";
+}
+
+void header() {
+  utsname u{};
+  uname(&u);
+  char date[32];
+  std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+  std::printf("# host %s\n", host_processor().c_str());
+  std::printf("# os %s %s %s\n", u.sysname, u.release, u.machine);
+  std::printf("# reference %s -O2\n", COIL_REFERENCE_CC);
+  std::printf("# date %s\n", date);
+  std::printf("# atomic and parallel tests run on 1 thread, the engine runs DIR_PARALLEL serially\n");
+  std::printf("processor\ttarget\tclass\ttest\tthreads\tthroughput\tlatency\tp99\tratio\tpass\n");
+}
+
+// Runs one test, prints its line and returns whether it passed
+bool run(const std::string &dir, const test &t, bool quick) {
+  std::string base = dir + "/" + t.cls + "/" + t.name;
+  bytes in = read(base + ".in"), expected = read(base + ".out");
+  if (in.size() != t.in_size || expected.size() != t.out_size) throw error("coil_bench: " + base + " has the wrong size");
+
+  engine e;
+  e.load(object::read_file(base + ".coil"));
+  function *fn = e.find("coil_test");
+  if (!fn) throw error("coil_bench: " + base + ".coil has no coil_test");
+  e.prepare(*fn);
+
+  bytes buf, out(t.out_size), ref(t.out_size);
+  uint64_t status = 0;
+  auto setup = [&] {
+    buf = in;
+    std::fill(out.begin(), out.end(), 0);
+  };
+  auto call = [&] {
+    uint64_t args[] = {reinterpret_cast<uint64_t>(buf.data()), reinterpret_cast<uint64_t>(out.data())};
+    e.call(*fn, args, {&status, 1});
+  };
+  setup();
+  call();
+  bool pass = static_cast<uint32_t>(status) == 0 && out == expected;
+  t.reference(in.data(), ref.data());
+  if (ref != expected) std::fprintf(stderr, "%s: the reference does not write the .out\n", base.c_str());
+  pass = pass && ref == expected;
+
+  std::string throughput = "-", latency = "-", tail = "-", ratio = "-";
+  if (pass) {
+    std::vector<double> coil = measure(setup, call, quick);
+    std::vector<double> native = measure([] {}, [&] { t.reference(in.data(), ref.data()); }, quick);
+    double ops = static_cast<double>(t.ops);
+    if (t.latency) {
+      latency = number(median(coil) / ops);
+      tail = number(p99(coil) / ops);
+    } else {
+      throughput = number(ops / median(coil) * 1e9);
+      tail = number(ops / p99(coil) * 1e9);
+    }
+    char r[32];
+    std::snprintf(r, sizeof r, "%.2f", median(native) / median(coil));
+    ratio = r;
+  }
+  std::printf("coil-engine v1\t%s\t%s\t%s\t1\t%s\t%s\t%s\t%s\t%s\n", target(), t.cls, t.name, throughput.c_str(), latency.c_str(),
+              tail.c_str(), ratio.c_str(), pass ? "yes" : "no");
+  return pass;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> args(argv + 1, argv + argc);
+  bool quick = !args.empty() && args[0] == "--quick";
+  bool regenerate = !args.empty() && args[0] == "--regenerate";
+  if (args.size() != (quick || regenerate ? 2u : 1u)) {
+    std::fprintf(stderr, "usage: coil_bench [--quick] <conformance dir>\n       coil_bench --regenerate <conformance dir>\n");
+    return 2;
+  }
+  const std::string &dir = args.back();
+  try {
+    if (regenerate) {
+      for (const test &t : tests) {
+        std::string base = dir + "/" + t.cls + "/" + t.name;
+        bytes in = make_input(t), out(t.out_size);
+        t.reference(in.data(), out.data());
+        write(base + ".in", in);
+        write(base + ".out", out);
+      }
+      return 0;
+    }
+    header();
+    bool all = true;
+    for (const test &t : tests) all = run(dir, t, quick) && all;
+    return all ? 0 : 1;
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+}